@@ -0,0 +1,126 @@
+/*
+   Copyright (c) 2026 Andreas F. Borchert
+   All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+   KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+   WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+
+/*
+   small helpers shared by the benchmark and stress test programs
+*/
+
+#ifndef MT_BENCHMARK_HPP
+#define MT_BENCHMARK_HPP 1
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace bench {
+
+class stopwatch {
+   public:
+      stopwatch() : start_time(clock::now()) {
+      }
+      void restart() {
+	 start_time = clock::now();
+      }
+      /* elapsed time in ns since construction or the last restart */
+      std::uint64_t elapsed() const {
+	 return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	    clock::now() - start_time).count();
+      }
+   private:
+      using clock = std::chrono::steady_clock;
+      clock::time_point start_time;
+};
+
+/* busy waiting for the given number of ns to simulate work */
+inline void spin(std::uint64_t ns) {
+   if (ns == 0) return;
+   stopwatch sw;
+   while (sw.elapsed() < ns);
+}
+
+/* peak resident set size of this process in KiB */
+inline long peak_rss() {
+   struct rusage usage;
+   if (getrusage(RUSAGE_SELF, &usage) < 0) return 0;
+   return usage.ru_maxrss;
+}
+
+/* 1, 2, 4, ... up to the number of hardware threads */
+inline std::vector<unsigned int> default_thread_counts() {
+   unsigned int max = std::thread::hardware_concurrency();
+   if (max == 0) max = 1;
+   std::vector<unsigned int> counts;
+   for (unsigned int n = 1; n < max; n *= 2) {
+      counts.push_back(n);
+   }
+   counts.push_back(max);
+   return counts;
+}
+
+/* parse a comma-separated list of thread counts like "1,2,8" */
+inline std::vector<unsigned int> parse_thread_counts(const std::string& s) {
+   std::vector<unsigned int> counts;
+   std::size_t pos = 0;
+   while (pos < s.size()) {
+      auto next = s.find(',', pos);
+      if (next == std::string::npos) next = s.size();
+      auto n = std::strtoul(s.substr(pos, next - pos).c_str(), nullptr, 10);
+      if (n > 0) counts.push_back(n);
+      pos = next + 1;
+   }
+   return counts;
+}
+
+/* simple table output with right-aligned columns */
+class table {
+   public:
+      table(std::ostream& out, std::vector<std::string> columns,
+	    int width = 14) :
+	    out(out), width(width) {
+	 for (auto& column: columns) {
+	    out << std::setw(width) << column;
+	 }
+	 out << std::endl;
+      }
+      template<typename... Values>
+      void row(const Values&... values) {
+	 ((out << std::setw(width) << values), ...);
+	 out << std::endl;
+      }
+   private:
+      std::ostream& out;
+      int width;
+};
+
+} // namespace bench
+
+#endif // of #ifndef MT_BENCHMARK_HPP
@@ -0,0 +1,120 @@
+/*
+   Copyright (c) 2026 Andreas F. Borchert
+   All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+   KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+   WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+
+/*
+   benchmark for long linear chains of tasks where each task
+   depends on its predecessor only; it reports the time per hop
+   for the construction and the execution of the chain
+*/
+
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+
+#include <unistd.h>
+
+#include <benchmark.hpp>
+#include <task.hpp>
+#include <thread_pool.hpp>
+
+namespace {
+
+const char* cmdname;
+
+void usage() {
+   std::cerr << "Usage: " << cmdname << " [options]\n"
+      "  -n length         length of the chain (1000000)\n"
+      "  -p counts         comma-separated list of thread counts\n"
+      "  -i iterations     runs per thread count (3)\n";
+   std::exit(1);
+}
+
+struct result {
+   std::uint64_t construction; /* in ns */
+   std::uint64_t execution; /* in ns */
+};
+
+/* the chain is constructed behind a closed gate and then executed;
+   the tasks do not refer to their predecessors such that
+   just the hops are measured */
+result run(mt::thread_pool& tp, std::uint64_t length,
+      std::uint64_t& count) {
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   bench::stopwatch sw;
+   mt::task<void> t = mt::submit(tp, {}, [=]() { opened.wait(); });
+   for (std::uint64_t i = 1; i < length; ++i) {
+      t = mt::submit(tp, {t}, [&count]() { ++count; });
+   }
+   result r;
+   r.construction = sw.elapsed();
+   sw.restart();
+   gate.set_value();
+   t->join();
+   r.execution = sw.elapsed();
+   return r;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+   cmdname = *argv;
+   std::uint64_t length = 1000000;
+   auto thread_counts = bench::default_thread_counts();
+   unsigned int iterations = 3;
+   int opt;
+   while ((opt = getopt(argc, argv, "n:p:i:")) != -1) {
+      switch (opt) {
+	 case 'n': length = std::strtoull(optarg, nullptr, 10); break;
+	 case 'p': thread_counts = bench::parse_thread_counts(optarg); break;
+	 case 'i': iterations = std::strtoul(optarg, nullptr, 10); break;
+	 default: usage();
+      }
+   }
+   if (optind != argc || length == 0 ||
+	 thread_counts.empty() || iterations == 0) {
+      usage();
+   }
+
+   bench::table table(std::cout, {"threads", "construct/hop",
+      "ns/hop", "peak RSS/KiB"});
+   for (auto threads: thread_counts) {
+      mt::thread_pool tp(threads);
+      result best{};
+      for (unsigned int i = 0; i < iterations; ++i) {
+	 std::uint64_t count = 0;
+	 auto r = run(tp, length, count);
+	 if (count != length - 1) {
+	    std::cerr << cmdname << ": wrong count with " <<
+	       threads << " threads" << std::endl;
+	    return 1;
+	 }
+	 if (i == 0 || r.execution < best.execution) best = r;
+      }
+      table.row(threads, (double) best.construction / length,
+	 (double) best.execution / length, bench::peak_rss());
+   }
+}
@@ -0,0 +1,250 @@
+/*
+   Copyright (c) 2026 Andreas F. Borchert
+   All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+   KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+   WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+
+/*
+   generator for random dependency graphs and their execution
+   by mt::submit, used by the stress test
+*/
+
+#ifndef MT_DAG_GENERATOR_HPP
+#define MT_DAG_GENERATOR_HPP 1
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark.hpp>
+#include <task.hpp>
+#include <thread_pool.hpp>
+
+namespace bench {
+
+/* distributions of the degrees and the task durations */
+enum class distribution {constant, uniform, geometric, exponential};
+
+struct dag_parameters {
+   std::size_t vertices = 1000;
+   std::size_t layer_width = 32; /* maximal number of vertices per layer */
+   /* in-degree of all vertices beyond the first layer */
+   distribution in_degree = distribution::uniform;
+   double mean_in_degree = 2;
+   /* dependencies are selected from the last window layers;
+      every vertex gets a weight drawn from the out-degree
+      distribution with mean 1 and is selected with a probability
+      proportional to it, i.e. its expected out-degree follows
+      this distribution; with preferential selection the probability
+      grows in addition with the out-degree reached so far, leading
+      to a power-law distribution of out-degrees with some hubs */
+   std::size_t window = 2;
+   distribution out_degree = distribution::constant;
+   bool preferential = false;
+   /* task durations in ns */
+   distribution duration = distribution::exponential;
+   double mean_duration = 10000;
+   /* fraction of tasks which return a task instead of a value */
+   double recursion = 0;
+   unsigned int seed = 1;
+};
+
+struct dag_vertex {
+   std::uint64_t duration; /* in ns */
+   bool recursive;
+   std::vector<std::size_t> dependencies;
+};
+
+/* vertices are stored in topological order */
+struct dag {
+   std::vector<dag_vertex> vertices;
+   std::size_t layers = 0;
+   std::size_t edges = 0;
+};
+
+namespace impl {
+
+template<typename RNG>
+double draw(RNG& rng, distribution d, double mean) {
+   switch (d) {
+      case distribution::constant:
+	 return mean;
+      case distribution::uniform:
+	 return std::uniform_real_distribution<double>(0, 2 * mean)(rng);
+      case distribution::geometric:
+	 return std::geometric_distribution<unsigned int>(
+	    1 / (mean + 1))(rng);
+      case distribution::exponential:
+	 return std::exponential_distribution<double>(1 / mean)(rng);
+   }
+   return mean;
+}
+
+} // namespace impl
+
+inline dag generate(const dag_parameters& params) {
+   std::mt19937_64 rng(params.seed);
+   dag g;
+   g.vertices.reserve(params.vertices);
+   std::vector<std::size_t> layer_start; /* index of first vertex per layer */
+   std::vector<std::size_t> out_degree;
+   std::vector<double> weight; /* selection weight per vertex */
+   std::uniform_int_distribution<std::size_t> width_dist(1,
+      std::max(params.layer_width, std::size_t{1}));
+   std::bernoulli_distribution recursive_dist(params.recursion);
+   while (g.vertices.size() < params.vertices) {
+      std::size_t layer = layer_start.size();
+      layer_start.push_back(g.vertices.size());
+      std::size_t width = std::min(width_dist(rng),
+	 params.vertices - g.vertices.size());
+      /* candidates are the vertices of the preceding window layers */
+      std::size_t first = layer >= params.window?
+	 layer_start[layer - params.window]: 0;
+      std::size_t candidates = layer_start[layer] - first;
+      for (std::size_t i = 0; i < width; ++i) {
+	 dag_vertex v;
+	 v.duration = std::max(0.0,
+	    impl::draw(rng, params.duration, params.mean_duration) + 0.5);
+	 v.recursive = recursive_dist(rng);
+	 if (candidates > 0) {
+	    auto degree = static_cast<std::size_t>(std::max(0.0,
+	       impl::draw(rng, params.in_degree, params.mean_in_degree) +
+		  0.5));
+	    degree = std::min(degree, candidates);
+	    while (v.dependencies.size() < degree) {
+	       std::size_t dep;
+	       if (params.preferential ||
+		     params.out_degree != distribution::constant) {
+		  std::vector<double> weights(candidates);
+		  for (std::size_t j = 0; j < candidates; ++j) {
+		     weights[j] = weight[first + j];
+		     if (params.preferential) {
+			weights[j] *= 1 + out_degree[first + j];
+		     }
+		  }
+		  dep = first + std::discrete_distribution<std::size_t>(
+		     weights.begin(), weights.end())(rng);
+	       } else {
+		  dep = first + std::uniform_int_distribution<std::size_t>(
+		     0, candidates - 1)(rng);
+	       }
+	       if (std::find(v.dependencies.begin(), v.dependencies.end(),
+		     dep) == v.dependencies.end()) {
+		  v.dependencies.push_back(dep);
+		  ++out_degree[dep];
+	       }
+	    }
+	    g.edges += degree;
+	 }
+	 g.vertices.push_back(std::move(v));
+	 out_degree.push_back(0);
+	 /* keep a small positive weight such that a layer
+	    of zero weights does not stall the selection */
+	 weight.push_back(std::max(1e-3,
+	    impl::draw(rng, params.out_degree, 1)));
+      }
+   }
+   g.layers = layer_start.size();
+   return g;
+}
+
+/* length of the longest path in ns,
+   i.e. a lower bound of the makespan */
+inline std::uint64_t critical_path(const dag& g) {
+   std::vector<std::uint64_t> finish(g.vertices.size());
+   std::uint64_t max = 0;
+   for (std::size_t i = 0; i < g.vertices.size(); ++i) {
+      std::uint64_t start = 0;
+      for (auto dep: g.vertices[i].dependencies) {
+	 start = std::max(start, finish[dep]);
+      }
+      finish[i] = start + g.vertices[i].duration;
+      max = std::max(max, finish[i]);
+   }
+   return max;
+}
+
+inline std::uint64_t total_work(const dag& g) {
+   std::uint64_t sum = 0;
+   for (auto& v: g.vertices) {
+      sum += v.duration;
+   }
+   return sum;
+}
+
+/* every vertex computes a value out of its index and the values
+   of its dependencies which allows to check the execution */
+inline std::uint64_t vertex_value(std::size_t index,
+      const std::vector<std::uint64_t>& values,
+      const std::vector<std::size_t>& dependencies) {
+   std::uint64_t value = index * 0x9e3779b97f4a7c15;
+   for (auto dep: dependencies) {
+      value = (value ^ values[dep]) * 0xbf58476d1ce4e5b9;
+   }
+   return value;
+}
+
+inline std::vector<std::uint64_t> expected_values(const dag& g) {
+   std::vector<std::uint64_t> values(g.vertices.size());
+   for (std::size_t i = 0; i < g.vertices.size(); ++i) {
+      values[i] = vertex_value(i, values, g.vertices[i].dependencies);
+   }
+   return values;
+}
+
+/* execute g through mt::submit and return the computed values;
+   the function returns when all tasks are finished */
+inline std::vector<std::uint64_t> execute(mt::thread_pool& tp, const dag& g) {
+   std::vector<std::uint64_t> values(g.vertices.size());
+   std::vector<mt::basic_task> tasks; tasks.reserve(g.vertices.size());
+   std::vector<mt::basic_task> dependencies;
+   for (std::size_t i = 0; i < g.vertices.size(); ++i) {
+      auto& v = g.vertices[i];
+      auto work = [i, &v, &values]() {
+	 spin(v.duration);
+	 values[i] = vertex_value(i, values, v.dependencies);
+	 return values[i];
+      };
+      dependencies.clear();
+      for (auto dep: v.dependencies) {
+	 dependencies.push_back(tasks[dep]);
+      }
+      if (v.recursive) {
+	 tasks.push_back(mt::submit(tp,
+	    dependencies.begin(), dependencies.end(), [&tp, work]() {
+	       return mt::submit(tp, {}, work);
+	    }));
+      } else {
+	 tasks.push_back(mt::submit(tp,
+	    dependencies.begin(), dependencies.end(), work));
+      }
+   }
+   /* wait for a final task that depends on all others */
+   mt::submit(tp, tasks.begin(), tasks.end(), []() {})->join();
+   return values;
+}
+
+} // namespace bench
+
+#endif // of #ifndef MT_DAG_GENERATOR_HPP
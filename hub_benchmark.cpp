@@ -0,0 +1,142 @@
+/*
+   Copyright (c) 2026 Andreas F. Borchert
+   All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+   KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+   WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+
+/*
+   benchmark for the concurrent construction of a dependency graph:
+   many producer threads attach dependents to a few hub vertices
+   which are kept unfinished until the construction is complete
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <benchmark.hpp>
+#include <task.hpp>
+#include <thread_pool.hpp>
+
+namespace {
+
+const char* cmdname;
+
+void usage() {
+   std::cerr << "Usage: " << cmdname << " [options]\n"
+      "  -h hubs           number of hub vertices (4)\n"
+      "  -n dependents     dependents submitted per producer (100000)\n"
+      "  -w workers        number of threads of the pool (4)\n"
+      "  -p counts         comma-separated list of producer counts\n"
+      "  -i iterations     runs per producer count (3)\n";
+   std::exit(1);
+}
+
+struct result {
+   std::uint64_t construction; /* in ns */
+   std::uint64_t total; /* in ns */
+};
+
+result run(unsigned int workers, unsigned int producers,
+      unsigned int hubs, unsigned int dependents) {
+   mt::thread_pool tp(workers);
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   auto root = mt::submit(tp, {}, [=]() { opened.wait(); });
+   std::vector<mt::task<void>> hub_tasks;
+   for (unsigned int i = 0; i < hubs; ++i) {
+      hub_tasks.push_back(mt::submit(tp, {root}, []() {}));
+   }
+
+   std::atomic<unsigned int> ready{0};
+   std::atomic<bool> go{false};
+   std::atomic<std::uint64_t> executed{0};
+   std::vector<std::thread> threads;
+   for (unsigned int p = 0; p < producers; ++p) {
+      threads.emplace_back([&, p]() {
+	 ++ready;
+	 while (!go) std::this_thread::yield();
+	 for (unsigned int i = 0; i < dependents; ++i) {
+	    mt::submit(tp, {hub_tasks[(p + i) % hubs]}, [&]() {
+	       executed.fetch_add(1, std::memory_order_relaxed);
+	    });
+	 }
+      });
+   }
+   while (ready < producers) std::this_thread::yield();
+   bench::stopwatch sw;
+   go = true;
+   for (auto& t: threads) t.join();
+   result r;
+   r.construction = sw.elapsed();
+   gate.set_value();
+   std::uint64_t expected = std::uint64_t(producers) * dependents;
+   while (executed.load(std::memory_order_relaxed) < expected) {
+      std::this_thread::yield();
+   }
+   r.total = sw.elapsed();
+   return r;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+   cmdname = *argv;
+   unsigned int hubs = 4;
+   unsigned int dependents = 100000;
+   unsigned int workers = 4;
+   auto producer_counts = bench::default_thread_counts();
+   unsigned int iterations = 3;
+   int opt;
+   while ((opt = getopt(argc, argv, "h:n:w:p:i:")) != -1) {
+      switch (opt) {
+	 case 'h': hubs = std::strtoul(optarg, nullptr, 10); break;
+	 case 'n': dependents = std::strtoul(optarg, nullptr, 10); break;
+	 case 'w': workers = std::strtoul(optarg, nullptr, 10); break;
+	 case 'p': producer_counts = bench::parse_thread_counts(optarg); break;
+	 case 'i': iterations = std::strtoul(optarg, nullptr, 10); break;
+	 default: usage();
+      }
+   }
+   if (optind != argc || hubs == 0 || workers == 0 ||
+	 producer_counts.empty() || iterations == 0) {
+      usage();
+   }
+
+   bench::table table(std::cout, {"producers", "edges/s",
+      "construct/ms", "total/ms"});
+   for (auto producers: producer_counts) {
+      result best{};
+      for (unsigned int i = 0; i < iterations; ++i) {
+	 auto r = run(workers, producers, hubs, dependents);
+	 if (i == 0 || r.construction < best.construction) best = r;
+      }
+      table.row(producers,
+	 std::uint64_t(producers) * dependents * 1e9 / best.construction,
+	 best.construction / 1e6, best.total / 1e6);
+   }
+}
@@ -0,0 +1,308 @@
+/*
+   Copyright (c) 2026 Andreas F. Borchert
+   All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+   KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+   WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+
+/*
+   benchmark that compares the scheduling overhead of mt::submit
+   with that of OpenMP tasks with depend clauses for some typical
+   shapes of dependency graphs; this needs to be compiled with
+   OpenMP support (e.g. -fopenmp for gcc)
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+#include <unistd.h>
+
+#include <benchmark.hpp>
+#include <task.hpp>
+#include <thread_pool.hpp>
+
+namespace {
+
+constexpr std::size_t chain_length = 100000;
+constexpr std::size_t fan_in_width = 100000;
+constexpr unsigned int fib_n = 22;
+constexpr std::size_t sort_size = 1 << 18;
+constexpr std::ptrdiff_t sort_cutoff = 32;
+
+/* chain: every task depends on its predecessor */
+
+std::uint64_t chain_mt(mt::thread_pool& tp) {
+   std::uint64_t counter = 0;
+   auto t = mt::submit(tp, {}, [&counter]() {
+      ++counter;
+   });
+   for (std::size_t i = 1; i < chain_length; ++i) {
+      t = mt::submit(tp, {t}, [&counter]() {
+	 ++counter;
+      });
+   }
+   t->join();
+   return counter;
+}
+
+std::uint64_t chain_omp() {
+   std::uint64_t counter = 0;
+   #pragma omp parallel
+   #pragma omp single
+   {
+      for (std::size_t i = 0; i < chain_length; ++i) {
+	 #pragma omp task depend(inout: counter) shared(counter)
+	 ++counter;
+      }
+      #pragma omp taskwait
+   }
+   return counter;
+}
+
+/* fan-in: many independent tasks and one that depends on all of them */
+
+std::uint64_t fan_in_mt(mt::thread_pool& tp) {
+   std::vector<std::uint64_t> values(fan_in_width);
+   std::vector<mt::task<void>> tasks; tasks.reserve(fan_in_width);
+   for (std::size_t i = 0; i < fan_in_width; ++i) {
+      tasks.push_back(mt::submit(tp, {}, [i, &values]() {
+	 values[i] = i;
+      }));
+   }
+   auto sum = mt::submit(tp, tasks.begin(), tasks.end(), [&values]() {
+      std::uint64_t sum = 0;
+      for (auto value: values) sum += value;
+      return sum;
+   });
+   return sum->get_value();
+}
+
+std::uint64_t fan_in_omp() {
+   std::vector<std::uint64_t> values(fan_in_width);
+   std::uint64_t* v = values.data();
+   int n = fan_in_width;
+   std::uint64_t sum = 0;
+   #pragma omp parallel
+   #pragma omp single
+   {
+      for (int i = 0; i < n; ++i) {
+	 #pragma omp task depend(out: v[i]) firstprivate(i)
+	 v[i] = i;
+      }
+      #pragma omp task depend(iterator(j=0:n), in: v[j]) shared(sum)
+      for (int i = 0; i < n; ++i) sum += v[i];
+      #pragma omp taskwait
+   }
+   return sum;
+}
+
+/* fib: recursively created tasks */
+
+mt::task<std::uint64_t> fib_mt(mt::thread_pool& tp, unsigned int n) {
+   if (n <= 1) {
+      return mt::submit(tp, {}, [n]() {
+	 return std::uint64_t{n};
+      });
+   }
+   auto sum1 = mt::submit(tp, {}, [&tp, n]() {
+      return fib_mt(tp, n-1);
+   });
+   auto sum2 = mt::submit(tp, {}, [&tp, n]() {
+      return fib_mt(tp, n-2);
+   });
+   return mt::submit(tp, {sum1, sum2}, [=]() {
+      return sum1->get_value() + sum2->get_value();
+   });
+}
+
+std::uint64_t fib_omp(unsigned int n) {
+   if (n <= 1) return n;
+   std::uint64_t x, y, sum;
+   #pragma omp task depend(out: x) shared(x)
+   x = fib_omp(n-1);
+   #pragma omp task depend(out: y) shared(y)
+   y = fib_omp(n-2);
+   #pragma omp task depend(in: x, y) depend(out: sum) shared(x, y, sum)
+   sum = x + y;
+   #pragma omp taskwait
+   return sum;
+}
+
+/* pqsort: parallel quicksort, see README.md;
+   the partition is three-way such that both halves shrink
+   even in the presence of duplicates */
+
+template<typename RandomIt>
+std::pair<RandomIt, RandomIt> partition(RandomIt begin, RandomIt end) {
+   auto pivot = *(std::next(begin, std::distance(begin, end)/2));
+   auto mid1 = std::partition(begin, end,
+      [=](const auto& value) { return value < pivot; });
+   auto mid2 = std::partition(mid1, end,
+      [=](const auto& value) { return !(pivot < value); });
+   return {mid1, mid2};
+}
+
+template<typename RandomIt>
+void sort_mt(mt::task_group& tg, RandomIt begin, RandomIt end) {
+   if (std::distance(begin, end) <= sort_cutoff) {
+      std::sort(begin, end); return;
+   }
+   auto p = tg.submit({}, [=]() {
+      return ::partition(begin, end);
+   });
+   tg.submit({p}, [=,&tg]() {
+      sort_mt(tg, begin, p->get_value().first);
+   });
+   tg.submit({p}, [=,&tg]() {
+      sort_mt(tg, p->get_value().second, end);
+   });
+}
+
+template<typename RandomIt>
+void sort_omp(RandomIt begin, RandomIt end) {
+   if (std::distance(begin, end) <= sort_cutoff) {
+      std::sort(begin, end); return;
+   }
+   std::pair<RandomIt, RandomIt> p;
+   #pragma omp task depend(out: p) shared(p)
+   p = ::partition(begin, end);
+   #pragma omp task depend(in: p) shared(p)
+   sort_omp(begin, p.first);
+   #pragma omp task depend(in: p) shared(p)
+   sort_omp(p.second, end);
+   #pragma omp taskwait
+}
+
+std::vector<int> sort_input() {
+   std::mt19937 rng(1);
+   std::vector<int> values(sort_size);
+   for (auto& value: values) value = rng();
+   return values;
+}
+
+std::uint64_t pqsort_mt(mt::thread_pool& tp) {
+   auto values = sort_input();
+   {
+      mt::task_group tg(tp);
+      sort_mt(tg, values.begin(), values.end());
+   }
+   return std::is_sorted(values.begin(), values.end());
+}
+
+std::uint64_t pqsort_omp() {
+   auto values = sort_input();
+   #pragma omp parallel
+   #pragma omp single
+   sort_omp(values.begin(), values.end());
+   return std::is_sorted(values.begin(), values.end());
+}
+
+struct shape {
+   const char* name;
+   std::function<std::uint64_t(mt::thread_pool&)> run_mt;
+   std::function<std::uint64_t()> run_omp;
+};
+
+const char* cmdname;
+
+void usage() {
+   std::cerr << "Usage: " << cmdname << " [-p thread counts] [-i iterations]"
+      << std::endl;
+   std::exit(1);
+}
+
+/* best time in ns out of the given number of iterations */
+template<typename F>
+std::uint64_t measure(unsigned int iterations, F&& f, std::uint64_t& result) {
+   std::uint64_t best = 0;
+   for (unsigned int i = 0; i < iterations; ++i) {
+      bench::stopwatch sw;
+      result = f();
+      auto elapsed = sw.elapsed();
+      if (i == 0 || elapsed < best) best = elapsed;
+   }
+   return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+   cmdname = *argv;
+   auto thread_counts = bench::default_thread_counts();
+   unsigned int iterations = 3;
+   int opt;
+   while ((opt = getopt(argc, argv, "p:i:")) != -1) {
+      switch (opt) {
+	 case 'p': thread_counts = bench::parse_thread_counts(optarg); break;
+	 case 'i': iterations = std::strtoul(optarg, nullptr, 10); break;
+	 default: usage();
+      }
+   }
+   if (optind != argc || thread_counts.empty() || iterations == 0) usage();
+
+   shape shapes[] = {
+      {"chain", chain_mt, chain_omp},
+      {"fan-in", fan_in_mt, fan_in_omp},
+      {"fib", [](mt::thread_pool& tp) {
+	 return fib_mt(tp, fib_n)->get_value();
+      }, []() {
+	 std::uint64_t result;
+	 #pragma omp parallel
+	 #pragma omp single
+	 result = fib_omp(fib_n);
+	 return result;
+      }},
+      {"pqsort", pqsort_mt, pqsort_omp},
+   };
+   bool ok = true;
+   bench::table table(std::cout,
+      {"shape", "threads", "mt/ms", "omp/ms", "ratio"});
+   for (auto threads: thread_counts) {
+      omp_set_num_threads(threads);
+      /* the pool is kept across all runs like the OpenMP runtime
+	 keeps its threads, i.e. its construction is not measured */
+      mt::thread_pool tp(threads);
+      for (auto& shape: shapes) {
+	 std::uint64_t mt_result, omp_result;
+	 auto mt_time = measure(iterations, [&]() {
+	    return shape.run_mt(tp);
+	 }, mt_result);
+	 auto omp_time = measure(iterations, shape.run_omp, omp_result);
+	 if (mt_result != omp_result) {
+	    std::cerr << cmdname << ": results of " << shape.name <<
+	       " differ" << std::endl;
+	    ok = false;
+	 }
+	 table.row(shape.name, threads, mt_time / 1e6, omp_time / 1e6,
+	    (double) mt_time / omp_time);
+      }
+   }
+   return !ok;
+}
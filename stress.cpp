@@ -0,0 +1,165 @@
+/*
+   Copyright (c) 2026 Andreas F. Borchert
+   All rights reserved.
+
+   Permission is hereby granted, free of charge, to any person obtaining
+   a copy of this software and associated documentation files (the
+   "Software"), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to
+   permit persons to whom the Software is furnished to do so, subject to
+   the following conditions:
+
+   The above copyright notice and this permission notice shall be
+   included in all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY
+   KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+   WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+   BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+   CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+
+/*
+   stress test that runs random dependency graphs across
+   varying numbers of threads and reports throughput,
+   makespan relative to its lower bound, and peak RSS
+*/
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+#include <benchmark.hpp>
+#include <dag_generator.hpp>
+#include <task.hpp>
+#include <thread_pool.hpp>
+
+namespace {
+
+const char* cmdname;
+
+void usage() {
+   std::cerr << "Usage: " << cmdname << " [options]\n"
+      "  -n vertices       number of vertices (default 1000)\n"
+      "  -w width          maximal number of vertices per layer (32)\n"
+      "  -d mean[:dist]    in-degree, dist is one of constant, uniform,\n"
+      "                    geometric, or exponential (2:uniform)\n"
+      "  -W window         number of preceding layers the dependencies\n"
+      "                    are selected from (2)\n"
+      "  -o dist           distribution of the out-degrees, one of\n"
+      "                    constant, uniform, geometric, or exponential\n"
+      "                    (constant)\n"
+      "  -P                preferential selection of dependencies,\n"
+      "                    i.e. power-law distributed out-degrees\n"
+      "  -t mean[:dist]    task duration in us, dist is one of constant,\n"
+      "                    uniform, or exponential (10:exponential)\n"
+      "  -r fraction       fraction of tasks returning tasks (0)\n"
+      "  -s seed           seed of the generator (1)\n"
+      "  -p counts         comma-separated list of thread counts\n"
+      "  -i iterations     runs per thread count (3)\n"
+      "  -x ratio          fail if makespan exceeds ratio times its bound\n";
+   std::exit(1);
+}
+
+void parse_distribution_name(const std::string& name,
+      bench::distribution& dist) {
+   if (name == "constant") {
+      dist = bench::distribution::constant;
+   } else if (name == "uniform") {
+      dist = bench::distribution::uniform;
+   } else if (name == "geometric") {
+      dist = bench::distribution::geometric;
+   } else if (name == "exponential") {
+      dist = bench::distribution::exponential;
+   } else {
+      usage();
+   }
+}
+
+void parse_distribution(const char* arg, double& mean,
+      bench::distribution& dist) {
+   std::string s(arg);
+   auto colon = s.find(':');
+   mean = std::strtod(s.substr(0, colon).c_str(), nullptr);
+   if (colon == std::string::npos) return;
+   parse_distribution_name(s.substr(colon + 1), dist);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+   cmdname = *argv;
+   bench::dag_parameters params;
+   auto thread_counts = bench::default_thread_counts();
+   unsigned int iterations = 3;
+   double max_ratio = 0;
+   int opt;
+   while ((opt = getopt(argc, argv, "n:w:d:W:o:Pt:r:s:p:i:x:")) != -1) {
+      switch (opt) {
+	 case 'n': params.vertices = std::strtoul(optarg, nullptr, 10); break;
+	 case 'w': params.layer_width = std::strtoul(optarg, nullptr, 10); break;
+	 case 'd':
+	    parse_distribution(optarg, params.mean_in_degree,
+	       params.in_degree);
+	    break;
+	 case 'W': params.window = std::strtoul(optarg, nullptr, 10); break;
+	 case 'o': parse_distribution_name(optarg, params.out_degree); break;
+	 case 'P': params.preferential = true; break;
+	 case 't':
+	    parse_distribution(optarg, params.mean_duration,
+	       params.duration);
+	    params.mean_duration *= 1000;
+	    break;
+	 case 'r': params.recursion = std::strtod(optarg, nullptr); break;
+	 case 's': params.seed = std::strtoul(optarg, nullptr, 10); break;
+	 case 'p': thread_counts = bench::parse_thread_counts(optarg); break;
+	 case 'i': iterations = std::strtoul(optarg, nullptr, 10); break;
+	 case 'x': max_ratio = std::strtod(optarg, nullptr); break;
+	 default: usage();
+      }
+   }
+   if (optind != argc || thread_counts.empty() || iterations == 0) usage();
+
+   auto g = bench::generate(params);
+   auto expected = bench::expected_values(g);
+   auto cp = bench::critical_path(g);
+   auto work = bench::total_work(g);
+   std::cout << g.vertices.size() << " vertices, " << g.edges <<
+      " edges, " << g.layers << " layers, critical path " <<
+      cp / 1e6 << " ms, total work " << work / 1e6 << " ms" << std::endl;
+
+   bool ok = true;
+   bench::table table(std::cout, {"threads", "tasks/s", "makespan/ms",
+      "bound/ms", "ratio", "peak RSS/KiB"});
+   for (auto threads: thread_counts) {
+      mt::thread_pool tp(threads);
+      std::uint64_t best = 0;
+      for (unsigned int i = 0; i < iterations; ++i) {
+	 bench::stopwatch sw;
+	 auto values = bench::execute(tp, g);
+	 auto makespan = sw.elapsed();
+	 if (values != expected) {
+	    std::cerr << cmdname << ": wrong results with " <<
+	       threads << " threads" << std::endl;
+	    return 1;
+	 }
+	 if (i == 0 || makespan < best) best = makespan;
+      }
+      auto bound = std::max(cp, work / threads);
+      double ratio = bound? (double) best / bound: 0;
+      table.row(threads, g.vertices.size() * 1e9 / best,
+	 best / 1e6, bound / 1e6, ratio, bench::peak_rss());
+      if (max_ratio > 0 && ratio > max_ratio) ok = false;
+   }
+   if (!ok) {
+      std::cerr << cmdname << ": makespan exceeds " << max_ratio <<
+	 " times its lower bound" << std::endl;
+      return 1;
+   }
+}
@@ -1,5 +1,5 @@
 /* 
-   Copyright (c) 2017, 2019, 2021, 2022, 2023 Andreas F. Borchert
+   Copyright (c) 2017, 2019, 2021, 2022, 2023, 2026 Andreas F. Borchert
    All rights reserved.
 
    Permission is hereby granted, free of charge, to any person obtaining
@@ -37,24 +37,1630 @@
 ISO C++ 2017 standard.
 #else
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <deque>
+#include <exception>
 #include <functional>
 #include <initializer_list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <ostream>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <utility>
+#include <vector>
+
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <climits>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+#ifdef MT_TASK_FIBERS
+#if !defined(__linux__) || !(defined(__x86_64__) || defined(__aarch64__))
+#error MT_TASK_FIBERS is supported on Linux for x86-64 and aarch64 only
+#endif
+#include <sys/mman.h>
+#include <ucontext.h>
+#endif
+#if defined(__SANITIZE_ADDRESS__)
+#  define MT_TASK_ASAN
+#elif defined(__has_feature)
+#  if __has_feature(address_sanitizer)
+#     define MT_TASK_ASAN
+#  endif
+#endif
+#if defined(__SANITIZE_THREAD__)
+#  define MT_TASK_TSAN
+#elif defined(__has_feature)
+#  if __has_feature(thread_sanitizer)
+#     define MT_TASK_TSAN
+#  endif
+#endif
+#ifdef MT_TASK_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
+#ifdef MT_TASK_TSAN
+#include <sanitizer/tsan_interface.h>
+#endif
 
 #include <thread_pool.hpp>
 
-namespace mt {
+namespace mt {
+
+/* task groups are used as a synchronization measure,
+   i.e. the destruction of a task group is delayed until
+   all its tasks are completed */
+class task_group;
+
+/* optional attributes of a task which may be passed
+   to the submission functions in front of the dependencies */
+struct task_attributes {
+   const char* label = nullptr; /* static string used by mt::metrics */
+   bool lazy = false; /* run only on demand, see mt::submit */
+};
+
+/* rules of a thread pool within a pool_group */
+struct balancing_rules {
+   bool lend = true; /* idle workers of siblings may run our jobs */
+   bool steal = true; /* our idle workers may run jobs of siblings */
+   std::size_t threshold = 1; /* minimal number of queued jobs to lend */
+   int priority = 0; /* siblings with higher priority are helped first */
+};
+
+/* optional latency instrumentation of the task layer:
+   if enabled, we record for every task
+     - the queueing time between becoming ready and
+       the start of its execution,
+     - the release time between the completion of its
+       last dependency and becoming ready (the cleanup hop), and
+     - its execution time
+   in HDR-style histograms which are kept per thread and
+   label and merged on read */
+namespace metrics {
+
+enum phase {queueing, release, execution};
+constexpr std::size_t phases = 3;
+
+/* log-linear histogram of nanosecond values with a relative
+   error below 1/16 covering values up to 2^44 ns (about 4.9 hours);
+   larger values are accounted to the last bucket */
+class histogram {
+   public:
+      static constexpr unsigned int sub_bucket_bits = 4;
+      static constexpr std::size_t sub_buckets = 1 << sub_bucket_bits;
+      static constexpr unsigned int max_magnitude = 44;
+      static constexpr std::size_t buckets =
+	 (max_magnitude - sub_bucket_bits + 1) * sub_buckets;
+
+      static std::size_t index(std::uint64_t value) {
+	 if (value < sub_buckets) return value;
+#if defined(__GNUC__)
+	 unsigned int magnitude = 63 - __builtin_clzll(value);
+#else
+	 unsigned int magnitude = 0;
+	 for (auto v = value; v > 1; v >>= 1) {
+	    ++magnitude;
+	 }
+#endif
+	 if (magnitude >= max_magnitude) return buckets - 1;
+	 unsigned int shift = magnitude - sub_bucket_bits;
+	 return (shift + 1) * sub_buckets + (value >> shift) - sub_buckets;
+      }
+      /* highest value that is accounted to the given bucket */
+      static std::uint64_t highest_value(std::size_t index) {
+	 if (index < sub_buckets) return index;
+	 unsigned int shift = index / sub_buckets - 1;
+	 std::uint64_t lowest = (index % sub_buckets + sub_buckets) << shift;
+	 return lowest + (std::uint64_t{1} << shift) - 1;
+      }
+
+      histogram() : counts(buckets) {
+      }
+      void add(std::size_t index, std::uint64_t n) {
+	 counts[index] += n; total += n;
+      }
+      void add_sum(std::uint64_t value) {
+	 sum_ += value;
+      }
+      void merge(const histogram& other) {
+	 for (std::size_t i = 0; i < buckets; ++i) {
+	    counts[i] += other.counts[i];
+	 }
+	 total += other.total; sum_ += other.sum_;
+      }
+      std::uint64_t count() const {
+	 return total;
+      }
+      std::uint64_t count(std::size_t index) const {
+	 return counts[index];
+      }
+      /* sum of all recorded values in ns */
+      std::uint64_t sum() const {
+	 return sum_;
+      }
+      /* value in ns below or at which q percent of all values fall */
+      std::uint64_t percentile(double q) const {
+	 if (total == 0) return 0;
+	 auto rank = static_cast<std::uint64_t>(q / 100 * total + 0.5);
+	 if (rank == 0) rank = 1;
+	 if (rank > total) rank = total;
+	 std::uint64_t seen = 0;
+	 for (std::size_t i = 0; i < buckets; ++i) {
+	    seen += counts[i];
+	    if (seen >= rank) return highest_value(i);
+	 }
+	 return highest_value(buckets - 1);
+      }
+      std::uint64_t p50() const {
+	 return percentile(50);
+      }
+      std::uint64_t p99() const {
+	 return percentile(99);
+      }
+      std::uint64_t p999() const {
+	 return percentile(99.9);
+      }
+   private:
+      std::vector<std::uint64_t> counts;
+      std::uint64_t total = 0;
+      std::uint64_t sum_ = 0;
+};
+
+/* merged histograms of one label, indexed by phase */
+using label_histograms = std::array<histogram, phases>;
+
+} // namespace metrics
+
+namespace impl {
+
+/* with MT_TASK_FIBERS, a task may be suspended and resumed by another
+   worker (see fibers), hence thread-local variables that are used
+   by tasks are accessed through functions which are neither inlined
+   nor considered as pure such that the compiler cannot reuse the
+   address of a thread-local variable of the previous worker */
+#ifdef MT_TASK_FIBERS
+#define MT_TASK_TLS_ACCESSOR [[gnu::noinline]]
+#define MT_TASK_TLS_BARRIER() asm volatile("")
+#else
+#define MT_TASK_TLS_ACCESSOR
+#define MT_TASK_TLS_BARRIER()
+#endif
+
+/* current time in ns, used by the instrumentation only */
+inline std::uint64_t now_ns() {
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline std::atomic<bool> metrics_enabled{false};
+
+/* sampling configuration, see mt::metrics::set_sampling_interval,
+   mt::metrics::sample_label, and mt::metrics::sample_critical_paths */
+inline std::atomic<unsigned int> sampling_interval{1};
+inline std::atomic<bool> sampling_follows_critical_paths{false};
+using label_set = std::vector<std::string>;
+inline std::atomic<const label_set*> sampled_labels{nullptr};
+
+MT_TASK_TLS_ACCESSOR inline unsigned int& sampling_countdown() {
+   MT_TASK_TLS_BARRIER();
+   thread_local unsigned int countdown = 0;
+   return countdown;
+}
+
+/* decide whether a newly submitted task with the given label
+   is to be recorded by the histograms */
+inline bool sample_task(const char* label) {
+   auto& countdown = sampling_countdown();
+   auto interval = sampling_interval.load(std::memory_order_relaxed);
+   if (interval > 0) {
+      if (countdown == 0 || countdown >= interval) {
+	 countdown = interval - 1;
+	 return true;
+      }
+      --countdown;
+   }
+   if (label) {
+      auto labels = sampled_labels.load(std::memory_order_acquire);
+      if (labels) {
+	 for (auto& l: *labels) {
+	    if (l == label) return true;
+	 }
+      }
+   }
+   return false;
+}
+
+/* increment of a counter that is updated by one thread only,
+   hence we do not need an atomic read-modify-write operation */
+inline void bump(std::atomic<std::uint64_t>& counter, std::uint64_t n = 1) {
+   counter.store(counter.load(std::memory_order_relaxed) + n,
+      std::memory_order_relaxed);
+}
+
+/* lock classes considered by the lock profiling */
+enum lock_class {
+   parking_lock, pool_lock,
+   lock_classes
+};
+enum lock_counter {
+   lock_acquisitions, lock_contentions, lock_wait_time,
+   lock_counters
+};
+
+/* event counters of the task layer, kept per thread */
+enum counter {
+   tasks_submitted, tasks_ready, tasks_started, tasks_finished,
+   jobs_submitted, jobs_started, jobs_finished,
+   counters
+};
+
+/* a histogram that is updated by its owning thread only
+   but may be read concurrently by other threads */
+class histogram_recorder {
+   public:
+      void record(std::uint64_t value) {
+	 bump(counts[metrics::histogram::index(value)]);
+	 bump(sum, value);
+      }
+      void merge_into(metrics::histogram& h) const {
+	 for (std::size_t i = 0; i < metrics::histogram::buckets; ++i) {
+	    auto n = counts[i].load(std::memory_order_relaxed);
+	    if (n > 0) h.add(i, n);
+	 }
+	 h.add_sum(sum.load(std::memory_order_relaxed));
+      }
+   private:
+      std::atomic<std::uint64_t> counts[metrics::histogram::buckets] = {};
+      std::atomic<std::uint64_t> sum{0};
+};
+
+/* histograms of one thread for one label */
+struct label_metrics {
+   label_metrics(const char* label, label_metrics* next) :
+	 label(label), next(next) {
+   }
+   const char* const label;
+   label_metrics* const next;
+   histogram_recorder histograms[metrics::phases];
+};
+
+/* per-thread metrics shards are registered in a global list;
+   they are never free'd but handed over to new threads
+   when their owning thread terminates */
+class thread_metrics {
+   public:
+      /* return the shard of the current thread */
+      MT_TASK_TLS_ACCESSOR static thread_metrics& get() {
+	 MT_TASK_TLS_BARRIER();
+	 thread_local owner current;
+	 return *current.shard;
+      }
+      /* return the histograms of the given label,
+	 must be invoked by the owning thread only */
+      label_metrics& lookup(const char* label) {
+	 if (!label) label = "";
+	 auto first = labels.load(std::memory_order_relaxed);
+	 for (auto p = first; p; p = p->next) {
+	    if (p->label == label || std::strcmp(p->label, label) == 0) {
+	       return *p;
+	    }
+	 }
+	 auto p = new label_metrics(label, first);
+	 labels.store(p, std::memory_order_release);
+	 return *p;
+      }
+      void record(const char* label, metrics::phase phase,
+	    std::uint64_t value) {
+	 lookup(label).histograms[phase].record(value);
+      }
+      void count(counter c) {
+	 bump(counts[c]);
+      }
+      std::uint64_t get_count(counter c) const {
+	 return counts[c].load(std::memory_order_relaxed);
+      }
+      void count(lock_class lc, lock_counter c, std::uint64_t n = 1) {
+	 bump(lock_counts[lc][c], n);
+      }
+      std::uint64_t get_count(lock_class lc, lock_counter c) const {
+	 return lock_counts[lc][c].load(std::memory_order_relaxed);
+      }
+      /* invoke f for all registered shards */
+      template<typename F>
+      static void for_each(F&& f) {
+	 for (auto p = registry().load(std::memory_order_acquire);
+	       p; p = p->next) {
+	    f(*p);
+	 }
+      }
+      const label_metrics* first_label() const {
+	 return labels.load(std::memory_order_acquire);
+      }
+   private:
+      std::atomic<label_metrics*> labels{nullptr};
+      std::atomic<std::uint64_t> counts[counters] = {};
+      std::atomic<std::uint64_t> lock_counts[lock_classes][lock_counters] = {};
+      std::atomic<bool> owned{true};
+      thread_metrics* next = nullptr;
+
+      static std::atomic<thread_metrics*>& registry() {
+	 static std::atomic<thread_metrics*> head{nullptr};
+	 return head;
+      }
+      struct owner {
+	 owner() {
+	    for (auto p = registry().load(std::memory_order_acquire);
+		  p; p = p->next) {
+	       bool expected = false;
+	       if (p->owned.compare_exchange_strong(expected, true,
+		     std::memory_order_acquire)) {
+		  shard = p; return;
+	       }
+	    }
+	    shard = new thread_metrics();
+	    shard->next = registry().load(std::memory_order_relaxed);
+	    while (!registry().compare_exchange_weak(shard->next, shard,
+		  std::memory_order_release, std::memory_order_relaxed));
+	 }
+	 ~owner() {
+	    shard->owned.store(false, std::memory_order_release);
+	 }
+	 thread_metrics* shard;
+      };
+};
+
+/* if MT_TASK_LOCK_PROFILING is defined, all mutexes of the task layer
+   count their acquisitions, contended acquisitions, and the time
+   spent waiting for them per lock class; an uncontended acquisition
+   costs just one additional try_lock and a thread-local increment */
+#ifdef MT_TASK_LOCK_PROFILING
+template<lock_class LC>
+class profiled_mutex {
+   public:
+      void lock() {
+	 if (!mutex.try_lock()) {
+	    auto start = now_ns();
+	    mutex.lock();
+	    auto& shard = thread_metrics::get();
+	    shard.count(LC, lock_contentions);
+	    shard.count(LC, lock_wait_time, now_ns() - start);
+	 }
+	 thread_metrics::get().count(LC, lock_acquisitions);
+      }
+      bool try_lock() {
+	 if (!mutex.try_lock()) return false;
+	 thread_metrics::get().count(LC, lock_acquisitions);
+	 return true;
+      }
+      void unlock() {
+	 mutex.unlock();
+      }
+   private:
+      std::mutex mutex;
+};
+template<lock_class LC> using mutex_type = profiled_mutex<LC>;
+#else
+template<lock_class LC> using mutex_type = std::mutex;
+#endif
+
+/* memory slots for the small objects of the task layer, i.e.
+   vertices, task records, and the nodes of the lists of dependents;
+   freed slots are kept in thread-local free lists which exchange
+   batches of slots with a global list; slots are never returned
+   to the system but reused */
+namespace slots {
+
+/* the slots are annotated for the sanitizers: free slots are
+   poisoned for the AddressSanitizer, except for the links of the
+   free lists, and every recycled slot is handed over from the
+   thread that freed it to the thread that allocates it such that
+   the ThreadSanitizer does not mistake a reuse for a data race;
+   the slots can be turned off by defining MT_TASK_NO_SLOTS */
+#ifdef MT_TASK_NO_SLOTS
+constexpr bool enabled = false;
+#else
+constexpr bool enabled = true;
+#endif
+
+constexpr std::size_t slot_size = 64;
+constexpr std::size_t classes = 8; /* slots of up to 512 bytes */
+constexpr std::size_t batch = 64; /* slots per batch */
+
+struct slot {
+   slot* next; /* within a batch */
+   slot* next_batch; /* valid for the first slot of a batch only */
+   std::size_t length; /* of the batch, valid for the first slot only */
+};
+
+/* the part of a free slot of the given class beyond its links
+   is not to be touched */
+inline void poison(slot* s, std::size_t c) {
+#ifdef MT_TASK_ASAN
+   ASAN_POISON_MEMORY_REGION(reinterpret_cast<char*>(s) + sizeof(slot),
+      (c + 1) * slot_size - sizeof(slot));
+#endif
+}
+/* the first size bytes of the slot are handed out */
+inline void unpoison(slot* s, std::size_t size) {
+#ifdef MT_TASK_ASAN
+   ASAN_UNPOISON_MEMORY_REGION(s, size);
+#endif
+}
+/* hand-off of recycled slots between threads */
+inline void release(slot* s) {
+#ifdef MT_TASK_TSAN
+   __tsan_release(s);
+#endif
+}
+inline void acquire(slot* s) {
+#ifdef MT_TASK_TSAN
+   __tsan_acquire(s);
+#endif
+}
+
+struct global_list {
+   std::mutex mutex;
+   slot* batches[classes] = {};
+};
+inline global_list global;
+
+inline constexpr std::size_t class_of(std::size_t size) {
+   return (size + slot_size - 1) / slot_size - 1;
+}
+
+inline void put_batch(std::size_t c, slot* first, std::size_t length) {
+   first->length = length;
+   std::lock_guard lock(global.mutex);
+   first->next_batch = global.batches[c];
+   global.batches[c] = first;
+}
+
+/* allocate a batch of fresh slots of the given class in one chunk */
+inline slot* new_batch(std::size_t c) {
+   auto size = (c + 1) * slot_size;
+   auto chunk = static_cast<char*>(::operator new(batch * size));
+   slot* first = nullptr;
+   for (std::size_t i = batch; i > 0; --i) {
+      auto s = reinterpret_cast<slot*>(chunk + (i - 1) * size);
+      s->next = first; first = s;
+      poison(s, c);
+   }
+   return first;
+}
+
+struct local_list {
+   slot* head[classes] = {};
+   std::size_t count[classes] = {};
+
+   ~local_list() {
+      for (std::size_t c = 0; c < classes; ++c) {
+	 while (head[c]) {
+	    auto first = head[c];
+	    auto last = first;
+	    std::size_t length = 1;
+	    while (length < batch && last->next) {
+	       last = last->next; ++length;
+	    }
+	    head[c] = last->next; last->next = nullptr;
+	    put_batch(c, first, length);
+	 }
+	 count[c] = 0;
+      }
+   }
+};
+inline thread_local local_list local;
+MT_TASK_TLS_ACCESSOR inline local_list& local_slots() {
+   MT_TASK_TLS_BARRIER();
+   return local;
+}
+
+inline void* allocate(std::size_t size) {
+   auto c = class_of(size);
+   if (!enabled || c >= classes) return ::operator new(size);
+   auto& l = local_slots();
+   if (!l.head[c]) {
+      slot* first = nullptr;
+      {
+	 std::lock_guard lock(global.mutex);
+	 first = global.batches[c];
+	 if (first) global.batches[c] = first->next_batch;
+      }
+      if (first) {
+	 l.count[c] = first->length;
+      } else {
+	 first = new_batch(c);
+	 l.count[c] = batch;
+      }
+      l.head[c] = first;
+   }
+   auto s = l.head[c];
+   l.head[c] = s->next; --l.count[c];
+   acquire(s);
+   unpoison(s, size);
+   return s;
+}
+
+inline void deallocate(void* p, std::size_t size) {
+   auto c = class_of(size);
+   if (!enabled || c >= classes) {
+      ::operator delete(p); return;
+   }
+   auto& l = local_slots();
+   auto s = static_cast<slot*>(p);
+   release(s);
+   poison(s, c);
+   s->next = l.head[c]; l.head[c] = s;
+   if (++l.count[c] >= 2 * batch) {
+      /* return one batch to the global list */
+      auto last = s;
+      for (std::size_t i = 1; i < batch; ++i) {
+	 last = last->next;
+      }
+      l.head[c] = last->next; last->next = nullptr;
+      l.count[c] -= batch;
+      put_batch(c, s, batch);
+   }
+}
+
+/* make sure that at least count slots for objects of
+   the given size are available in the global list */
+inline void reserve(std::size_t size, std::size_t count) {
+   auto c = class_of(size);
+   if (!enabled || c >= classes) return;
+   for (std::size_t n = 0; n < count; n += batch) {
+      put_batch(c, new_batch(c), batch);
+   }
+}
+
+template<typename T>
+struct allocator {
+   using value_type = T;
+   allocator() = default;
+   template<typename U> allocator(const allocator<U>&) {
+   }
+   T* allocate(std::size_t n) {
+      if constexpr (alignof(T) > alignof(std::max_align_t)) {
+	 return std::allocator<T>().allocate(n);
+      } else {
+	 return static_cast<T*>(slots::allocate(n * sizeof(T)));
+      }
+   }
+   void deallocate(T* p, std::size_t n) {
+      if constexpr (alignof(T) > alignof(std::max_align_t)) {
+	 std::allocator<T>().deallocate(p, n);
+      } else {
+	 slots::deallocate(p, n * sizeof(T));
+      }
+   }
+   template<typename U> bool operator==(const allocator<U>&) const {
+      return true;
+   }
+   template<typename U> bool operator!=(const allocator<U>&) const {
+      return false;
+   }
+};
+
+template<typename T, typename... Args>
+std::shared_ptr<T> make_shared(Args&&... args) {
+   return std::allocate_shared<T>(allocator<T>(),
+      std::forward<Args>(args)...);
+}
+
+template<typename T, typename... Args>
+T* create(Args&&... args) {
+   return new (slots::allocate(sizeof(T))) T{std::forward<Args>(args)...};
+}
+template<typename T>
+void destroy(T* p) {
+   p->~T();
+   slots::deallocate(p, sizeof(T));
+}
+
+} // namespace slots
+
+/* waiting for a 32-bit word to change its value from the expected
+   value where wake_all wakes up all threads waiting for the word;
+   on Linux this is done using futexes, otherwise we fall back to
+   a fixed table of condition variables which are selected by
+   the address of the word; in both cases, spurious wakeups
+   are possible */
+namespace futex {
+
+using word_type = std::atomic<std::uint32_t>;
+static_assert(sizeof(word_type) == sizeof(std::uint32_t),
+   "atomic words must be usable as futexes");
+using clock = std::chrono::steady_clock;
+
+#if defined(__linux__)
+inline void wait(const word_type& word, std::uint32_t expected) {
+   syscall(SYS_futex, reinterpret_cast<const std::uint32_t*>(&word),
+      FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+inline void wait_until(const word_type& word, std::uint32_t expected,
+      clock::time_point deadline) {
+   auto now = clock::now();
+   if (now >= deadline) return;
+   auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      deadline - now).count();
+   struct timespec timeout;
+   timeout.tv_sec = ns / 1000000000;
+   timeout.tv_nsec = ns % 1000000000;
+   syscall(SYS_futex, reinterpret_cast<const std::uint32_t*>(&word),
+      FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+}
+inline void wake_all(const word_type& word) {
+   syscall(SYS_futex, reinterpret_cast<const std::uint32_t*>(&word),
+      FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+#else
+struct bucket {
+   std::mutex mutex;
+   std::condition_variable cv;
+};
+inline bucket& bucket_of(const word_type& word) {
+   static bucket buckets[64];
+   auto address = reinterpret_cast<std::uintptr_t>(&word);
+   return buckets[(address / sizeof(word)) % 64];
+}
+inline void wait(const word_type& word, std::uint32_t expected) {
+   auto& b = bucket_of(word);
+   std::unique_lock lock(b.mutex);
+   if (word.load(std::memory_order_acquire) == expected) {
+      b.cv.wait(lock);
+   }
+}
+inline void wait_until(const word_type& word, std::uint32_t expected,
+      clock::time_point deadline) {
+   auto& b = bucket_of(word);
+   std::unique_lock lock(b.mutex);
+   if (word.load(std::memory_order_acquire) == expected) {
+      b.cv.wait_until(lock, deadline);
+   }
+}
+inline void wake_all(const word_type& word) {
+   auto& b = bucket_of(word);
+   std::lock_guard lock(b.mutex);
+   b.cv.notify_all();
+}
+#endif
+
+} // namespace futex
+
+/* global address-keyed parking lot in the style of WebKit:
+   threads park at an arbitrary address in one of a fixed number
+   of buckets where they wait on a thread-local futex word;
+   hence objects that are waited for need no synchronization
+   state of their own beyond a bit that tells whether somebody
+   is parked and there is no kernel object involved
+   until some thread actually has to sleep */
+namespace parking_lot {
+
+using clock = futex::clock;
+
+struct parker {
+   futex::word_type parked{0};
+   const void* address = nullptr;
+   parker* next = nullptr;
+   /* invoked instead of waking up a thread if non-null, see fibers */
+   void (*wake)(parker*) = nullptr;
+};
+inline thread_local parker self;
+
+struct bucket {
+   mutex_type<parking_lock> mutex;
+   parker* head = nullptr;
+   parker* tail = nullptr;
+};
+constexpr std::size_t buckets = 256;
+
+inline bucket& bucket_of(const void* address) {
+   static bucket table[buckets];
+   auto key = reinterpret_cast<std::uintptr_t>(address) /
+      alignof(std::uint32_t);
+   return table[(key ^ (key >> 8)) % buckets];
+}
+
+/* remove p from b if it is still there, b must be locked */
+inline bool remove(bucket& b, parker* p) {
+   parker* prev = nullptr;
+   for (auto q = b.head; q; prev = q, q = q->next) {
+      if (q != p) continue;
+      if (prev) {
+	 prev->next = q->next;
+      } else {
+	 b.head = q->next;
+      }
+      if (b.tail == q) b.tail = prev;
+      return true;
+   }
+   return false;
+}
+
+/* enqueue p at the given address provided that validate,
+   which is invoked while the bucket is locked, returns true */
+template<typename Validate>
+bool enqueue(parker* p, const void* address, Validate validate) {
+   auto& b = bucket_of(address);
+   std::lock_guard lock(b.mutex);
+   if (!validate()) return false;
+   p->address = address; p->next = nullptr;
+   p->parked.store(1, std::memory_order_relaxed);
+   if (b.tail) {
+      b.tail->next = p;
+   } else {
+      b.head = p;
+   }
+   b.tail = p;
+   return true;
+}
+
+/* park the current thread at the given address until it is
+   unparked or the deadline is reached, provided that validate
+   returns true, see enqueue;
+   returns false if validate failed or the deadline was reached */
+template<typename Validate>
+bool park_until(const void* address, Validate validate,
+      clock::time_point deadline) {
+   auto& b = bucket_of(address);
+   auto p = &self;
+   if (!enqueue(p, address, validate)) return false;
+   while (p->parked.load(std::memory_order_acquire)) {
+      if (deadline == clock::time_point::max()) {
+	 futex::wait(p->parked, 1);
+      } else if (clock::now() < deadline) {
+	 futex::wait_until(p->parked, 1, deadline);
+      } else {
+	 bool removed;
+	 {
+	    std::lock_guard lock(b.mutex);
+	    removed = remove(b, p);
+	 }
+	 if (removed) return false;
+	 /* we are about to be unparked */
+	 while (p->parked.load(std::memory_order_acquire)) {
+	    std::this_thread::yield();
+	 }
+      }
+   }
+   return true;
+}
+template<typename Validate>
+bool park(const void* address, Validate validate) {
+   return park_until(address, validate, clock::time_point::max());
+}
+
+/* unpark all threads parked at the given address */
+inline void unpark_all(const void* address) {
+   auto& b = bucket_of(address);
+   parker* unparked = nullptr;
+   {
+      std::lock_guard lock(b.mutex);
+      parker* prev = nullptr;
+      auto q = b.head;
+      while (q) {
+	 auto next = q->next;
+	 if (q->address == address) {
+	    if (prev) {
+	       prev->next = next;
+	    } else {
+	       b.head = next;
+	    }
+	    if (b.tail == q) b.tail = prev;
+	    q->next = unparked; unparked = q;
+	 } else {
+	    prev = q;
+	 }
+	 q = next;
+      }
+   }
+   while (unparked) {
+      /* the parker must not be touched once parked is cleared
+	 as its thread may continue and terminate; a wakeup of
+	 a stale address is just a spurious wakeup */
+      auto next = unparked->next;
+      if (unparked->wake) {
+	 unparked->wake(unparked);
+      } else {
+	 auto& parked = unparked->parked;
+	 parked.store(0, std::memory_order_release);
+	 futex::wake_all(parked);
+      }
+      unparked = next;
+   }
+}
+
+} // namespace parking_lot
+
+/* optional execution of jobs on fibers, i.e. on pooled user-mode
+   stacks, if MT_TASK_FIBERS is defined: a task that waits for
+   the result of another task suspends its fiber instead of blocking
+   its worker which returns to the thread pool and picks up other
+   jobs; the fiber is parked at the result in the parking lot and
+   resumed by a new job as soon as the result is available,
+   possibly by another worker */
+namespace fibers {
+
+#ifdef MT_TASK_FIBERS
+inline std::atomic<bool> enabled{true};
+inline std::atomic<std::size_t> stack_size{128 * 1024};
+constexpr std::size_t max_free = 64; /* fibers cached per worker */
+
+struct worker;
+struct fiber: parking_lot::parker {
+   ucontext_t context;
+   char* stack = nullptr; /* including the guard page */
+   std::size_t size = 0;
+   std::function<void()> body;
+   bool finished = false;
+   thread_pool* pool = nullptr; /* which is used to resume us */
+   worker* current = nullptr; /* worker we are running on */
+   fiber* next_free = nullptr;
+};
+
+inline void destroy(fiber* f);
+
+/* state of a worker, i.e. of a thread that runs fibers */
+struct worker {
+   ucontext_t context;
+   fiber* current = nullptr;
+   /* word and value the current fiber is to be parked at */
+   const futex::word_type* word = nullptr;
+   std::uint32_t expected = 0;
+   fiber* free = nullptr;
+   std::size_t free_count = 0;
+
+   ~worker() {
+      while (free) {
+	 auto f = free; free = f->next_free;
+	 destroy(f);
+      }
+   }
+};
+MT_TASK_TLS_ACCESSOR inline worker& current_worker() {
+   MT_TASK_TLS_BARRIER();
+   thread_local worker w;
+   return w;
+}
+
+/* the fiber is passed in two halves as makecontext
+   passes int arguments only */
+inline void entry(unsigned int high, unsigned int low) {
+   auto f = reinterpret_cast<fiber*>(
+      (std::uintptr_t(high) << 32) | std::uintptr_t(low));
+   for (;;) {
+      f->body();
+      f->body = nullptr;
+      f->finished = true;
+      swapcontext(&f->context, &f->current->context);
+   }
+}
+
+inline void wake(parking_lot::parker* p);
+
+/* returns a null pointer if no stack could be allocated */
+inline fiber* create() {
+   std::size_t page = sysconf(_SC_PAGESIZE);
+   auto size = (stack_size.load(std::memory_order_relaxed) +
+      page - 1) / page * page + page;
+   auto memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+   if (memory == MAP_FAILED) return nullptr;
+   mprotect(memory, page, PROT_NONE);
+   auto f = new fiber();
+   f->wake = wake;
+   f->stack = static_cast<char*>(memory); f->size = size;
+   getcontext(&f->context);
+   f->context.uc_stack.ss_sp = f->stack + page;
+   f->context.uc_stack.ss_size = size - page;
+   f->context.uc_link = nullptr;
+   auto address = reinterpret_cast<std::uintptr_t>(f);
+   makecontext(&f->context, reinterpret_cast<void (*)()>(entry), 2,
+      static_cast<unsigned int>(address >> 32),
+      static_cast<unsigned int>(address));
+   return f;
+}
+inline void destroy(fiber* f) {
+   munmap(f->stack, f->size);
+   delete f;
+}
+
+/* run f on the current worker until it is finished or suspended;
+   a suspended fiber is parked at the word it waits for unless
+   the word has changed in the meantime */
+inline void switch_to(fiber* f) {
+   auto& w = current_worker();
+   for (;;) {
+      f->current = &w; w.current = f;
+      swapcontext(&w.context, &f->context);
+      w.current = nullptr;
+      if (f->finished) {
+	 f->finished = false;
+	 if (w.free_count < max_free) {
+	    f->next_free = w.free; w.free = f; ++w.free_count;
+	 } else {
+	    destroy(f);
+	 }
+	 return;
+      }
+      /* f may be resumed by another worker as soon as it is parked */
+      auto word = w.word; auto expected = w.expected;
+      if (parking_lot::enqueue(f, word, [=]() {
+	    return word->load(std::memory_order_relaxed) == expected;
+	 })) {
+	 return;
+      }
+   }
+}
+
+/* run the given job on a fiber of the current worker */
+template<typename Job>
+void execute(thread_pool& tp, Job& job) {
+   if (!enabled.load(std::memory_order_relaxed)) {
+      job(); return;
+   }
+   auto& w = current_worker();
+   fiber* f = nullptr;
+   if (w.current) {
+      /* we are already running on a fiber */
+   } else if (w.free) {
+      f = w.free; w.free = f->next_free; --w.free_count;
+   } else {
+      f = create();
+   }
+   if (!f) {
+      job(); return;
+   }
+   f->body = std::move(job);
+   f->pool = &tp;
+   switch_to(f);
+}
+
+/* suspend the current fiber, if any, until the word no longer
+   has the expected value; returns false if we are not
+   running on a fiber */
+[[gnu::noinline]] inline bool suspend(const futex::word_type& word,
+      std::uint32_t expected) {
+   auto& w = current_worker();
+   auto f = w.current;
+   if (!f) return false;
+   w.word = &word; w.expected = expected;
+   /* we may return on another worker */
+   swapcontext(&f->context, &w.context);
+   return true;
+}
+#else
+template<typename Job>
+void execute(thread_pool& tp, Job& job) {
+   job();
+}
+inline bool suspend(const futex::word_type& word, std::uint32_t expected) {
+   return false;
+}
+#endif
+
+} // namespace fibers
+
+/* extensions of the opaque thread pools, like the compensation of
+   a pool, are found by the address of the pool; the registry refers
+   weakly to the extensions which are owned by the objects that set
+   them up and, while they are in use, by the jobs that refer to them;
+   owners remove their entries before they go away, hence a later
+   pool at the same address never finds a stale extension */
+template<typename Extension>
+class pool_registry {
+   public:
+      std::shared_ptr<Extension> lookup(const thread_pool& tp) const {
+	 if (size.load(std::memory_order_acquire) == 0) return nullptr;
+	 std::shared_lock lock(mutex);
+	 for (auto& entry: entries) {
+	    if (entry.pool == &tp) return entry.extension.lock();
+	 }
+	 return nullptr;
+      }
+      /* returns false if tp has an extension already */
+      bool add(thread_pool& tp, const std::shared_ptr<Extension>& extension) {
+	 std::unique_lock lock(mutex);
+	 prune();
+	 for (auto& entry: entries) {
+	    if (entry.pool == &tp) return false;
+	 }
+	 entries.push_back({&tp, extension});
+	 size.store(entries.size(), std::memory_order_release);
+	 return true;
+      }
+      /* the extension of tp which is created by make if there is none */
+      template<typename Make>
+      std::shared_ptr<Extension> obtain(thread_pool& tp, Make make) {
+	 std::unique_lock lock(mutex);
+	 prune();
+	 for (auto& entry: entries) {
+	    if (entry.pool == &tp) return entry.extension.lock();
+	 }
+	 std::shared_ptr<Extension> extension = make();
+	 entries.push_back({&tp, extension});
+	 size.store(entries.size(), std::memory_order_release);
+	 return extension;
+      }
+      void remove(const Extension* extension) {
+	 std::unique_lock lock(mutex);
+	 entries.erase(std::remove_if(entries.begin(), entries.end(),
+	    [=](const entry& e) {
+	       auto p = e.extension.lock();
+	       return !p || p.get() == extension;
+	    }), entries.end());
+	 size.store(entries.size(), std::memory_order_release);
+      }
+   private:
+      struct entry {
+	 const thread_pool* pool;
+	 std::weak_ptr<Extension> extension;
+      };
+      mutable std::shared_mutex mutex;
+      std::vector<entry> entries;
+      std::atomic<std::size_t> size{0};
+
+      void prune() {
+	 entries.erase(std::remove_if(entries.begin(), entries.end(),
+	    [](const entry& e) { return e.extension.expired(); }),
+	    entries.end());
+      }
+};
+
+/* managed blocking: workers that block, either in a wait of the
+   task layer or within a blocking_section, are compensated by
+   additional workers up to a bound that is configured per pool;
+   as the queue of the thread pool is not accessible, the jobs of
+   a compensated pool are queued here and fetched either by a token
+   job which is submitted to the pool or by a compensating worker;
+   compensating workers retire as soon as they outnumber the
+   blocked workers */
+namespace compensation {
+
+struct pool_state: std::enable_shared_from_this<pool_state> {
+   mutex_type<pool_lock> mutex;
+   std::condition_variable_any cv;
+   std::condition_variable_any retired; /* signalled by the last worker */
+   std::deque<std::function<void()>> jobs;
+   unsigned int max_workers = 0;
+   bool closed = false; /* no more compensating workers are started */
+   unsigned int blocked = 0; /* workers within a blocking section */
+   unsigned int workers = 0; /* compensating workers */
+};
+
+/* the states are owned by mt::blocking_compensation objects */
+inline pool_registry<pool_state> registry;
+
+/* state of the compensated pool the current thread works for */
+MT_TASK_TLS_ACCESSOR inline pool_state*& current() {
+   MT_TASK_TLS_BARRIER();
+   thread_local pool_state* state = nullptr;
+   return state;
+}
+
+/* run job as worker of s */
+template<typename Job>
+void run(pool_state& s, Job& job) {
+   auto& state = current();
+   auto previous = state;
+   state = &s;
+   job();
+   current() = previous;
+}
+
+/* main loop of a compensating worker */
+inline void compensate(pool_state& s) {
+   std::unique_lock lock(s.mutex);
+   for (;;) {
+      if (s.workers > s.blocked) {
+	 if (--s.workers == 0) s.retired.notify_all();
+	 return;
+      }
+      if (s.jobs.empty()) {
+	 s.cv.wait(lock); continue;
+      }
+      auto job = std::move(s.jobs.front());
+      s.jobs.pop_front();
+      lock.unlock();
+      run(s, job);
+      lock.lock();
+   }
+}
+
+inline void begin_blocking(pool_state& s) {
+   std::lock_guard lock(s.mutex);
+   ++s.blocked;
+   if (!s.closed && s.workers < s.blocked && s.workers < s.max_workers) {
+      ++s.workers;
+      try {
+	 /* the owner of s waits for us to retire, see close() */
+	 std::thread([s = s.shared_from_this()]() {
+	    compensate(*s);
+	 }).detach();
+      } catch (...) {
+	 --s.workers;
+      }
+   }
+}
+inline void end_blocking(pool_state& s) {
+   std::lock_guard lock(s.mutex);
+   --s.blocked;
+   if (s.workers > s.blocked) s.cv.notify_all();
+}
+
+/* no compensating workers are started after the current ones
+   retired which is awaited; queued jobs are left to their tokens */
+inline void close(pool_state& s) {
+   std::unique_lock lock(s.mutex);
+   s.retired.wait(lock, [&s]() { return s.workers == 0; });
+   s.closed = true;
+}
+
+/* marks the lifetime of an object as blocking section
+   if we are a worker of a compensated pool */
+class blocking {
+   public:
+      blocking() : state(current()) {
+	 if (state) begin_blocking(*state);
+      }
+      ~blocking() {
+	 if (state) end_blocking(*state);
+      }
+      blocking(const blocking&) = delete;
+      blocking& operator=(const blocking&) = delete;
+   private:
+      pool_state* state;
+};
+
+/* submit the given job to the thread pool */
+template<typename Job>
+void submit(thread_pool& tp, Job&& job) {
+   auto s = registry.lookup(tp);
+   if (!s) {
+      tp.submit(std::forward<Job>(job)); return;
+   }
+   {
+      std::lock_guard lock(s->mutex);
+      s->jobs.emplace_back(std::forward<Job>(job));
+      if (s->workers > 0) s->cv.notify_one();
+   }
+   tp.submit([s = std::move(s)]() {
+      std::function<void()> job;
+      {
+	 std::lock_guard lock(s->mutex);
+	 /* possibly taken by a compensating worker */
+	 if (s->jobs.empty()) return;
+	 job = std::move(s->jobs.front());
+	 s->jobs.pop_front();
+      }
+      run(*s, job);
+   });
+}
+
+} // namespace compensation
+
+/* cooperating thread pools: the jobs of a pool which belongs to a
+   pool group are queued here and fetched by token jobs like those
+   of compensated pools; every job has a token in its own pool, and
+   if all workers of its pool are busy, an additional token that
+   steals is submitted to a sibling which has idle workers;
+   as the thread pools tell neither their number of workers nor
+   their load, the number of workers is configured and every token
+   which is not finished yet counts as a busy worker;
+   the members are owned by their group and kept alive by their
+   tokens; they are found through the registry as long as they
+   belong to their group */
+namespace balancing {
+
+struct group_state;
+
+struct member {
+   thread_pool* pool = nullptr;
+   std::weak_ptr<group_state> group;
+   std::atomic<bool> active{true}; /* still belongs to its group */
+   std::atomic<unsigned int> workers{0};
+   std::atomic<bool> lend{true};
+   std::atomic<bool> steal{true};
+   std::atomic<std::size_t> threshold{1};
+   std::atomic<int> priority{0};
+   mutex_type<pool_lock> mutex;
+   std::deque<std::function<void()>> jobs;
+   std::atomic<std::size_t> queued{0};
+   std::atomic<unsigned int> tokens{0}; /* submitted and not finished */
+};
+
+struct group_state {
+   std::shared_mutex mutex;
+   std::vector<std::shared_ptr<member>> members;
+};
+
+inline pool_registry<member> registry;
+
+inline void set_rules(member& m, unsigned int workers,
+      const balancing_rules& rules) {
+   m.workers.store(workers? workers: 1, std::memory_order_relaxed);
+   m.lend.store(rules.lend, std::memory_order_relaxed);
+   m.steal.store(rules.steal, std::memory_order_relaxed);
+   m.threshold.store(rules.threshold, std::memory_order_relaxed);
+   m.priority.store(rules.priority, std::memory_order_relaxed);
+}
+
+/* returns false if the pool belongs to another group */
+inline bool join(const std::shared_ptr<group_state>& g, thread_pool& tp,
+      unsigned int workers, const balancing_rules& rules) {
+   std::unique_lock lock(g->mutex);
+   if (auto m = registry.lookup(tp)) {
+      if (m->group.lock() != g) return false;
+      set_rules(*m, workers, rules);
+      return true;
+   }
+   auto m = std::make_shared<member>();
+   m->pool = &tp;
+   m->group = g;
+   set_rules(*m, workers, rules);
+   if (!registry.add(tp, m)) return false;
+   g->members.push_back(std::move(m));
+   return true;
+}
+
+/* jobs which are already queued remain with their tokens */
+inline void leave(member& m) {
+   m.active.store(false, std::memory_order_relaxed);
+   registry.remove(&m);
+}
+
+inline void leave(group_state& g, thread_pool& tp) {
+   std::unique_lock lock(g.mutex);
+   auto it = std::find_if(g.members.begin(), g.members.end(),
+      [&](const std::shared_ptr<member>& m) { return m->pool == &tp; });
+   if (it == g.members.end()) return;
+   leave(**it);
+   g.members.erase(it);
+}
+
+inline void dissolve(group_state& g) {
+   std::unique_lock lock(g.mutex);
+   for (auto& m: g.members) leave(*m);
+   g.members.clear();
+}
+
+inline std::function<void()> take(member& m) {
+   if (m.queued.load(std::memory_order_relaxed) == 0) return nullptr;
+   std::lock_guard lock(m.mutex);
+   if (m.jobs.empty()) return nullptr;
+   auto job = std::move(m.jobs.front());
+   m.jobs.pop_front();
+   m.queued.store(m.jobs.size(), std::memory_order_relaxed);
+   return job;
+}
+
+/* take a job of the sibling with the highest priority and,
+   among these, with the largest number of queued jobs */
+inline std::function<void()> steal(member& m) {
+   if (!m.active.load(std::memory_order_relaxed) ||
+	 !m.steal.load(std::memory_order_relaxed)) {
+      return nullptr;
+   }
+   auto g = m.group.lock();
+   if (!g) return nullptr;
+   std::shared_ptr<member> victim;
+   {
+      std::shared_lock lock(g->mutex);
+      std::size_t victim_queued = 0;
+      int victim_priority = 0;
+      for (auto& sibling: g->members) {
+	 if (sibling.get() == &m ||
+	       !sibling->lend.load(std::memory_order_relaxed)) {
+	    continue;
+	 }
+	 auto queued = sibling->queued.load(std::memory_order_relaxed);
+	 if (queued == 0 ||
+	       queued < sibling->threshold.load(std::memory_order_relaxed)) {
+	    continue;
+	 }
+	 auto priority = sibling->priority.load(std::memory_order_relaxed);
+	 if (!victim || priority > victim_priority ||
+	       (priority == victim_priority && queued > victim_queued)) {
+	    victim = sibling;
+	    victim_queued = queued; victim_priority = priority;
+	 }
+      }
+   }
+   if (!victim) return nullptr;
+   return take(*victim);
+}
+
+/* a token runs a job of its own pool, if there is any,
+   otherwise it keeps stealing jobs of its siblings */
+inline void run(member& m) {
+   for (;;) {
+      if (auto job = take(m)) {
+	 job(); break;
+      }
+      auto job = steal(m);
+      if (!job) break;
+      job();
+   }
+   m.tokens.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/* send a stealing token to a sibling of m with idle workers, if any */
+inline void help(member& m) {
+   if (!m.lend.load(std::memory_order_relaxed) ||
+	 m.queued.load(std::memory_order_relaxed) <
+	    m.threshold.load(std::memory_order_relaxed)) {
+      return;
+   }
+   auto g = m.group.lock();
+   if (!g) return;
+   std::shared_ptr<member> helper;
+   {
+      std::shared_lock lock(g->mutex);
+      for (auto& sibling: g->members) {
+	 if (sibling.get() == &m ||
+	       !sibling->steal.load(std::memory_order_relaxed)) {
+	    continue;
+	 }
+	 auto workers = sibling->workers.load(std::memory_order_relaxed);
+	 if (sibling->tokens.fetch_add(1, std::memory_order_relaxed) >=
+	       workers) {
+	    sibling->tokens.fetch_sub(1, std::memory_order_relaxed);
+	    continue;
+	 }
+	 helper = sibling; break;
+      }
+   }
+   if (helper) {
+      auto& pool = *helper->pool;
+      compensation::submit(pool, [helper]() { run(*helper); });
+   }
+}
+
+/* submit the given job to the thread pool */
+template<typename Job>
+void submit(thread_pool& tp, Job&& job) {
+   auto m = registry.lookup(tp);
+   if (!m) {
+      compensation::submit(tp, std::forward<Job>(job)); return;
+   }
+   {
+      std::lock_guard lock(m->mutex);
+      m->jobs.emplace_back(std::forward<Job>(job));
+      m->queued.store(m->jobs.size(), std::memory_order_relaxed);
+   }
+   auto busy = m->tokens.fetch_add(1, std::memory_order_relaxed);
+   compensation::submit(tp, [m]() { run(*m); });
+   if (busy >= m->workers.load(std::memory_order_relaxed)) help(*m);
+}
+
+} // namespace balancing
+
+/* the jobs of tasks which are bound to a task arena are passed to
+   a dispatcher instead of the thread pool; dispatchers are reference
+   counted as they are shared by the tasks bound to them */
+class dispatcher {
+   public:
+      virtual ~dispatcher() = default;
+      virtual void dispatch(std::function<void()> job) = 0;
+      void retain() {
+	 refs.fetch_add(1, std::memory_order_relaxed);
+      }
+      /* fails if the dispatcher is about to be deleted */
+      bool try_retain() {
+	 auto n = refs.load(std::memory_order_relaxed);
+	 while (n > 0 && !refs.compare_exchange_weak(n, n + 1,
+	       std::memory_order_relaxed));
+	 return n > 0;
+      }
+      void release() {
+	 if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+      }
+   private:
+      std::atomic<std::size_t> refs{1};
+};
+
+/* a job which is run at most once by whoever takes it first,
+   i.e. by its token in the queue of the thread pool or,
+   if it became urgent, by the next worker of its pool */
+class runnable {
+   public:
+      ~runnable() {
+	 if (via) via->release();
+      }
+      void set(thread_pool* tp, std::function<void()> job_func) {
+	 pool = tp;
+	 job = std::move(job_func);
+      }
+      /* returns an empty function if the job has already been taken */
+      std::function<void()> take() {
+	 if (taken.exchange(true, std::memory_order_acq_rel)) return nullptr;
+	 auto f = std::move(job);
+	 job = nullptr;
+	 return f;
+      }
+      bool is_taken() const {
+	 return taken.load(std::memory_order_acquire);
+      }
+      thread_pool* get_pool() const {
+	 return pool;
+      }
+      /* our job is to be passed to the given dispatcher, if any */
+      void set_dispatcher(dispatcher* d) {
+	 assert(!via);
+	 if (d) d->retain();
+	 via = d;
+      }
+      dispatcher* get_dispatcher() const {
+	 return via;
+      }
+   protected:
+      thread_pool* pool = nullptr; /* null if job is to be invoked directly */
+      dispatcher* via = nullptr;
+      std::function<void()> job;
+   private:
+      std::atomic<bool> taken{false};
+};
+
+/* jobs of tasks that somebody waits for are queued in the urgent
+   lane of their pool in addition to the queue of the thread pool;
+   the lanes are looked at by every worker of the task layer before
+   it runs its next job such that urgent jobs overtake jobs which
+   were queued earlier in the thread pool */
+namespace urgent {
 
-/* task groups are used as a synchronization measure,
-   i.e. the destruction of a task group is delayed until
-   all its tasks are completed */
-class task_group;
+/* a lane exists only while it is not empty as meanwhile
+   it keeps itself alive, see pool_registry */
+struct lane: std::enable_shared_from_this<lane> {
+   mutex_type<pool_lock> mutex;
+   std::deque<std::shared_ptr<runnable>> jobs;
+   std::shared_ptr<lane> self; /* set while jobs is not empty */
+};
 
-namespace impl {
+inline pool_registry<lane> lanes;
+inline std::atomic<std::size_t> pending{0}; /* jobs of all lanes */
+
+/* jobs of task arenas remain in their arenas */
+inline void push(std::shared_ptr<runnable> r) {
+   if (r->is_taken() || !r->get_pool() || r->get_dispatcher()) return;
+   auto l = lanes.obtain(*r->get_pool(), []() {
+      return std::make_shared<lane>();
+   });
+   std::lock_guard lock(l->mutex);
+   if (l->jobs.empty()) l->self = l;
+   l->jobs.push_back(std::move(r));
+   pending.fetch_add(1, std::memory_order_relaxed);
+}
+
+/* take the first urgent job of the given pool, if any */
+inline std::function<void()> take(thread_pool& tp) {
+   auto l = lanes.lookup(tp);
+   if (!l) return nullptr;
+   std::lock_guard lock(l->mutex);
+   while (!l->jobs.empty()) {
+      auto owner = std::move(l->jobs.front());
+      l->jobs.pop_front();
+      pending.fetch_sub(1, std::memory_order_relaxed);
+      if (l->jobs.empty()) l->self = nullptr;
+      /* jobs which were taken by their tokens are just dropped */
+      auto job = owner->take();
+      if (!job) continue;
+      /* the job may refer to its owner which is otherwise
+	 kept alive by the token in the pool only */
+      return [owner = std::move(owner), job = std::move(job)]() {
+	 job();
+      };
+   }
+   return nullptr;
+}
+
+} // namespace urgent
+
+/* a task which becomes ready when its only dependency finishes
+   is handed off to the worker that finished the dependency
+   instead of passing it through the queue of the thread pool;
+   it is run by run_job after the current job returned
+   such that chains do not grow the stack */
+struct handoff_state {
+   bool active = false; /* we are within run_job */
+   thread_pool* pool = nullptr; /* of run_job, if active */
+   bool armed = false; /* next ready task may be handed off */
+   std::function<void()> job;
+};
+inline thread_local handoff_state handoff;
+MT_TASK_TLS_ACCESSOR inline handoff_state& current_handoff() {
+   MT_TASK_TLS_BARRIER();
+   return handoff;
+}
+
+/* run the urgent jobs of the pool, then first on the current worker,
+   where each of them is followed by the jobs handed off by it */
+template<typename First>
+void run_job(thread_pool& tp, First&& first) {
+   auto& h = current_handoff();
+   h.active = true;
+   h.pool = &tp;
+   auto run_handoffs = [&]() {
+      while (h.job) {
+	 auto next = std::move(h.job);
+	 h.job = nullptr;
+	 fibers::execute(tp, next);
+      }
+   };
+   while (urgent::pending.load(std::memory_order_relaxed) > 0) {
+      auto job = urgent::take(tp);
+      if (!job) break;
+      fibers::execute(tp, job);
+      run_handoffs();
+   }
+   first();
+   run_handoffs();
+   h.active = false;
+}
+
+#ifdef MT_TASK_FIBERS
+/* resume the fiber by a new job of its thread pool */
+inline void fibers::wake(parking_lot::parker* p) {
+   auto f = static_cast<fiber*>(p);
+   compensation::submit(*f->pool, [f]() {
+      run_job(*f->pool, [f]() {
+	 switch_to(f);
+      });
+   });
+}
+#endif
+
+/* all jobs of the task layer are passed to the thread pool
+   through this function which keeps track of them if the
+   instrumentation is active */
+template<typename Job>
+void submit_job(thread_pool& tp, Job&& job) {
+#ifdef MT_TASK_LOCK_PROFILING
+   /* the queue of the thread pool is not accessible, hence
+      we account the whole time spent in submit as waiting time */
+   auto start = now_ns();
+#endif
+   if (metrics_enabled.load(std::memory_order_relaxed)) {
+      thread_metrics::get().count(jobs_submitted);
+      balancing::submit(tp,
+	    [&tp, job = std::forward<Job>(job)]() mutable {
+	 thread_metrics::get().count(jobs_started);
+	 run_job(tp, [&]() {
+	    fibers::execute(tp, job);
+	 });
+	 thread_metrics::get().count(jobs_finished);
+      });
+   } else {
+      balancing::submit(tp,
+	    [&tp, job = std::forward<Job>(job)]() mutable {
+	 run_job(tp, [&]() {
+	    fibers::execute(tp, job);
+	 });
+      });
+   }
+#ifdef MT_TASK_LOCK_PROFILING
+   auto& shard = thread_metrics::get();
+   shard.count(pool_lock, lock_acquisitions);
+   shard.count(pool_lock, lock_wait_time, now_ns() - start);
+#endif
+}
 
 /* the dependencies are organized in a directed,
    hopefully anti-cyclic graph with task_handle_rec object
@@ -67,7 +1673,7 @@ using task_handle = std::shared_ptr<task_handle_rec>;
 /* submission functions return a shared_ptr to
    a composite object task_rec that consists of
      - a shared_ptr to the corresponding vertice in the graph and
-     - a shared_future object to access the result
+     - a result slot to access the result
 */
 class basic_task_rec;
 using basic_task = std::shared_ptr<basic_task_rec>;
@@ -75,7 +1681,8 @@ template<typename T> class task_rec;
 template<typename T> using task = std::shared_ptr<task_rec<T>>;
 
 /* task handles are used as vertices of the dependency graph */
-class task_handle_rec: public std::enable_shared_from_this<task_handle_rec> {
+class task_handle_rec: public runnable,
+      public std::enable_shared_from_this<task_handle_rec> {
    public:
       using State = enum {PREPARING, WAITING, SUBMITTED, FINISHED};
 	 /*
@@ -85,83 +1692,278 @@ class task_handle_rec: public std::enable_shared_from_this<task_handle_rec> {
 	    FINISHED:  task is finished
 	 */
       ~task_handle_rec() {
-	 assert(state == FINISHED);
+	 /* lazy tasks that were never demanded are never finished */
+	 assert(state == FINISHED || lazy);
+	 auto list = dependents.load(std::memory_order_relaxed);
+	 if (list != closed()) {
+	    while (list) {
+	       auto next = list->next; slots::destroy(list); list = next;
+	    }
+	 }
+	 if (links.load(std::memory_order_relaxed) != links_dropped) {
+	    free_links();
+	 }
       }
-      /* set function that submits this task to its thread pool;
-         as we bury this operation into a function object, we
-	 do not need a reference to the thread pool in task_handle_rec */
+      /* set the job which is to be submitted to the given
+	 thread pool as soon as all dependencies are resolved */
+      void set_job(thread_pool& tp, std::function<void()> job_func) {
+	 assert(state == PREPARING && !job && job_func);
+	 pool = &tp;
+	 job = std::move(job_func);
+      }
+      /* set function that is invoked instead of a job
+	 as soon as all dependencies are resolved */
       void set_submit_task(std::function<void()> submit_task_func) {
-	 std::lock_guard lock(mutex);
-	 assert(state == PREPARING && !submit_task && submit_task_func);
-	 submit_task = submit_task_func;
+	 assert(state == PREPARING && !job && submit_task_func);
+	 job = std::move(submit_task_func);
       }
-      /* add another dependency during the preparatory phase */
+      /* set the label and take the decisions whether this task
+	 is to be counted and whether its latencies are to be recorded;
+	 must be invoked before any dependencies are added */
+      void set_attributes(const task_attributes& attributes) {
+	 label = attributes.label;
+	 if (metrics_enabled.load(std::memory_order_relaxed)) {
+	    counted = true;
+	    sampled = sample_task(label);
+	    thread_metrics::get().count(tasks_submitted);
+	 }
+      }
+      /* our job is to be submitted only when we are demanded,
+	 see demand(); must be invoked before any dependencies are added */
+      void set_lazy() {
+	 assert(state == PREPARING && registered == 0);
+	 lazy = true;
+	 lazy_state.store(0, std::memory_order_relaxed);
+      }
+      /* add another dependency during the preparatory phase;
+	 the preparatory phase is not shared among threads,
+	 hence we just count the registered dependencies;
+	 the links, however, may be visited by boost() meanwhile
+	 as we are already known, see fix_indirection */
       bool add_dependency(task_handle dependency) {
-	 std::lock_guard lock(mutex);
 	 assert(state == PREPARING);
+	 if (!dependency) return false; /* finished root task */
 	 if (dependency->add_dependent(shared_from_this())) {
-	    ++dependencies_left;
+	    ++registered;
+	    if (dependency->lazy && !lazy) dependency->demand();
+	    if (lock_links()) {
+	       add_link(std::move(dependency));
+	       unlock_links();
+	    }
 	    return true;
 	 } else {
 	    return false;
 	 }
       }
-      /* end preparatory phase */
-      void finish_preparation() {
-	 bool do_enqueue = false;
-	 {
-	    std::lock_guard lock(mutex);
-	    assert(state == PREPARING);
-	    if (dependencies_left == 0) {
-	       do_enqueue = true;
-	    } else {
-	       state = WAITING;
+      /* add a range of dependencies in one pass, where Iterator
+	 refers to tasks; dependencies which are already finished
+	 are skipped without any further ado */
+      template<typename Iterator>
+      void add_dependencies(Iterator begin, Iterator end) {
+	 assert(state == PREPARING);
+	 task_handle self;
+	 for (auto it = begin; it != end; ++it) {
+	    auto dependency = (*it)->get_nested_handle();
+	    if (!dependency || dependency->finished()) continue;
+	    if (!self) self = shared_from_this();
+	    if (dependency->add_dependent(self)) {
+	       ++registered;
+	       if (dependency->lazy && !lazy) dependency->demand();
+	       add_link(std::move(dependency));
 	    }
 	 }
-	 if (do_enqueue) {
-	    enqueue();
+      }
+      /* end preparatory phase by publishing the number of
+	 registered dependencies which removes the bias;
+	 if all dependencies were already finished, we
+	 are submitted right away */
+      void finish_preparation() {
+	 assert(state == PREPARING);
+	 if (registered == 0) {
+	    /* nobody else knows of our counter */
+	    dependencies_left.store(0, std::memory_order_relaxed);
+	    resolve();
+	    return;
+	 }
+	 state.store(WAITING, std::memory_order_relaxed);
+	 auto delta = preparing - registered;
+	 if (dependencies_left.fetch_sub(delta,
+	       std::memory_order_acq_rel) == delta) {
+	    resolve();
 	 }
       }
+      /* vertex of a root task which is already submitted
+	 but had no vertex so far, see basic_task_rec;
+	 origin is the job of the root task */
+      static task_handle submitted(std::weak_ptr<runnable> origin) {
+	 auto vertex = slots::make_shared<task_handle_rec>();
+	 vertex->state.store(SUBMITTED, std::memory_order_relaxed);
+	 vertex->origin = std::move(origin);
+	 return vertex;
+      }
+      /* size of the nodes of the list of dependents */
+      static constexpr std::size_t dependent_size() {
+	 return sizeof(dependent);
+      }
+      /* lock-free check whether we are already finished */
+      bool finished() const {
+	 return dependents.load(std::memory_order_acquire) == closed();
+      }
       /* enlist t as one of our dependents,
-         i.e. when we finish we have to decrement the
+	 i.e. when we finish we have to decrement the
 	 number of dependencies of t;
-	 we return false if we are already finished, otherwise true */
+	 we return false if we are already finished, otherwise true;
+	 this is lock-free as popular vertices are possibly
+	 shared by many dependents which are submitted concurrently */
       bool add_dependent(task_handle t) {
-	 std::lock_guard lock(mutex);
-	 if (state == FINISHED) {
-	    return false;
+	 auto head = dependents.load(std::memory_order_acquire);
+	 if (head == closed()) return false; /* see finished() */
+	 if (t->sampled) {
+	    sampled_dependents.store(true, std::memory_order_relaxed);
+	 }
+	 /* lazy dependents may never be demanded and are hence not
+	    kept alive by us as they keep us alive, see add_link */
+	 dependent* node;
+	 if (t->lazy) {
+	    node = slots::create<dependent>(nullptr, std::move(t), head);
 	 } else {
-	    dependents.push_back(t);
-	    return true;
+	    node = slots::create<dependent>(std::move(t),
+	       std::weak_ptr<task_handle_rec>(), head);
+	 }
+	 while (!dependents.compare_exchange_weak(node->next, node,
+	       std::memory_order_release, std::memory_order_acquire)) {
+	    if (node->next == closed()) {
+	       slots::destroy(node); return false;
+	    }
 	 }
+	 return true;
       }
-      /* invoked by one of the tasks we depend on when it is finished */
-      void remove_dependency() {
-	 bool do_enqueue = false;
-	 {
-	    std::lock_guard lock(mutex);
-	    if (--dependencies_left == 0) {
-	       if (state == PREPARING) return; // postponed
-	       assert(state == WAITING);
-	       do_enqueue = true;
+      /* invoked by one of the tasks we depend on when it is finished;
+	 finish_time is non-zero if we or the finished task are sampled */
+      void remove_dependency(std::uint64_t finish_time,
+	    bool sampled_dependency) {
+	 if (dependencies_left.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+	    return;
+	 }
+	 /* the finished task is on our critical path */
+	 if (counted && sampled_dependency &&
+	       sampling_follows_critical_paths.load(
+		  std::memory_order_relaxed)) {
+	    sampled = true;
+	 }
+	 if (sampled && finish_time) {
+	    ready_time = now_ns();
+	    thread_metrics::get().record(label, metrics::phase::release,
+	       ready_time - finish_time);
+	 }
+	 resolve();
+      }
+      /* all dependencies are resolved: we are enqueued unless we
+	 are lazy and nobody has demanded us yet */
+      void resolve() {
+	 drop_links();
+	 if (lazy) {
+	    if (state.load(std::memory_order_relaxed) == PREPARING) {
+	       state.store(WAITING, std::memory_order_relaxed);
+	    }
+	    if (!(lazy_state.fetch_or(resolved,
+		  std::memory_order_acq_rel) & demanded)) {
+	       return;
 	    }
 	 }
-	 if (do_enqueue) {
-	    enqueue();
+	 enqueue();
+      }
+      /* somebody needs our result, i.e. a waiter or a dependent
+	 which is not lazy: demand us and, transitively, all
+	 lazy dependencies that have not been demanded yet;
+	 the lazy vertices are kept alive by the links to them */
+      void demand() {
+	 if (!lazy) return;
+	 std::vector<task_handle> stack{shared_from_this()};
+	 while (!stack.empty()) {
+	    auto vertex = std::move(stack.back()); stack.pop_back();
+	    auto previous = vertex->lazy_state.fetch_or(demanded,
+	       std::memory_order_acq_rel);
+	    if (previous & demanded) continue;
+	    if (previous & resolved) {
+	       vertex->enqueue(); continue;
+	    }
+	    vertex->visit_links([&](const task_handle& dependency) {
+	       if (dependency->lazy) stack.push_back(dependency);
+	    });
 	 }
       }
-      /* submit our task in the corresponding thread pool by
-	 invoking the stored function object submit_task */
+      /* submit our job to the corresponding thread pool,
+	 hand it off to the current worker, or invoke
+	 the stored submit function;
+	 if somebody waits for us already, the job remains with us
+	 such that it can be taken by the urgent lane, and the pool
+	 receives just a token that takes it */
       void enqueue() {
-	 {
-	    std::lock_guard lock(mutex);
-	    state = SUBMITTED;
+	 if (counted) {
+	    thread_metrics::get().count(tasks_ready);
+	    if (sampled && !ready_time) ready_time = now_ns();
 	 }
-	 submit_task();
-	 {
-	    /* be friendly to the std::shared_ptr-style of garbage collecting */
-	    std::lock_guard lock(mutex);
-	    submit_task = nullptr;
+	 state.store(SUBMITTED, std::memory_order_relaxed);
+	 if (!pool) {
+	    auto f = std::move(job);
+	    job = nullptr;
+	    f();
+	    return;
+	 }
+	 /* dependents in other pools or in task arenas remain in their
+	    pools or arenas; a dependent which is handed off to us is
+	    run next anyway and hence does not need the urgent lane */
+	 auto& h = current_handoff();
+	 bool handoff = !via && h.armed && !h.job && h.pool == pool;
+	 /* a boost that comes too late for this check just misses
+	    the lane as the job is already on its way to the pool */
+	 if (!via && !handoff && urgent.load(std::memory_order_relaxed)) {
+	    auto self = shared_from_this();
+	    impl::urgent::push(self);
+	    submit_job(*pool, [self = std::move(self)]() {
+	       if (auto job = self->take()) job();
+	    });
+	    return;
+	 }
+	 /* be friendly to the std::shared_ptr-style of garbage collecting */
+	 std::function<void()> f = std::move(job);
+	 job = nullptr;
+	 if (lazy) {
+	    /* the job of a lazy task does not keep its vertex alive */
+	    f = [self = shared_from_this(), f = std::move(f)]() {
+	       f();
+	    };
+	 }
+	 if (via) {
+	    via->dispatch(std::move(f));
+	 } else if (handoff) {
+	    h.armed = false;
+	    h.job = std::move(f);
+	 } else {
+	    submit_job(*pool, std::move(f));
+	 }
+      }
+      /* somebody waits for us: mark us and all unfinished tasks
+	 we transitively depend on as urgent such that they enter
+	 the urgent lane as soon as they are ready, and move the jobs
+	 of root tasks which are already queued into the urgent lane;
+	 vertices which are already urgent are not visited again */
+      void boost() {
+	 std::vector<task_handle> stack{shared_from_this()};
+	 while (!stack.empty()) {
+	    auto vertex = std::move(stack.back()); stack.pop_back();
+	    if (vertex->finished() ||
+		  vertex->urgent.exchange(true, std::memory_order_acq_rel)) {
+	       continue;
+	    }
+	    if (auto origin = vertex->origin.lock()) {
+	       impl::urgent::push(std::move(origin));
+	    } else {
+	       vertex->visit_links([&](const task_handle& dependency) {
+		  stack.push_back(dependency);
+	       });
+	    }
 	 }
       }
       /* this method is invoked when the task is completed;
@@ -171,51 +1973,342 @@ class task_handle_rec: public std::enable_shared_from_this<task_handle_rec> {
 	 finish returns
       */
       [[nodiscard]] auto finish() {
-	 std::lock_guard lock(mutex);
 	 assert(state == SUBMITTED);
 	 /* we are done */
-	 state = FINISHED;
+	 state.store(FINISHED, std::memory_order_relaxed);
+	 /* close the list of dependents and reverse it
+	    such that the dependents are notified in the
+	    order of their registration */
+	 auto list = dependents.exchange(closed(), std::memory_order_acq_rel);
+	 dependent* first = nullptr;
+	 while (list) {
+	    auto next = list->next; list->next = first;
+	    first = list; list = next;
+	 }
 	 /* postpone removal of dependencies until
 	    set_value of the associated promise has
 	    been called */
-	 return [dependents = std::move(dependents)]() {
-	    for (auto dependent: dependents) {
-	       dependent->remove_dependency();
+	 std::uint64_t finish_time = 0;
+	 if (sampled_dependents.load(std::memory_order_relaxed) ||
+	       (sampled && first)) {
+	    finish_time = now_ns();
+	 }
+	 return release{first, finish_time, sampled};
+      }
+      /* instrumentation hooks which are invoked by the job
+	 immediately before and after the execution of the task */
+      std::uint64_t start_execution() {
+	 if (!counted) return 0;
+	 auto& shard = thread_metrics::get();
+	 shard.count(tasks_started);
+	 if (!sampled) return 0;
+	 auto now = now_ns();
+	 shard.record(label, metrics::phase::queueing, now - ready_time);
+	 return now;
+      }
+      void end_execution(std::uint64_t start_time) {
+	 if (!counted) return;
+	 auto& shard = thread_metrics::get();
+	 if (sampled) {
+	    shard.record(label, metrics::phase::execution,
+	       now_ns() - start_time);
+	 }
+	 shard.count(tasks_finished);
+      }
+
+   private:
+      /* node of the lock-free stack of dependents
+	 where either vertex or lazy_vertex is set */
+      struct dependent {
+	 task_handle vertex;
+	 std::weak_ptr<task_handle_rec> lazy_vertex;
+	 dependent* next;
+      };
+      /* dependents of a finished task, see finish();
+	 the function object must be invoked exactly once */
+      struct release {
+	 dependent* first;
+	 std::uint64_t finish_time;
+	 bool sampled;
+
+	 bool at_most_one() const {
+	    return !first || !first->next;
+	 }
+	 void operator()() const {
+	    auto p = first;
+	    while (p) {
+	       if (p->vertex) {
+		  p->vertex->remove_dependency(finish_time, sampled);
+	       } else if (auto vertex = p->lazy_vertex.lock()) {
+		  vertex->remove_dependency(finish_time, sampled);
+	       }
+	       auto next = p->next; slots::destroy(p); p = next;
 	    }
-	 };
+	 }
+      };
+      /* node of the list of the vertices we depend on beyond the
+	 first one which is kept inline such that chains need no nodes;
+	 the links are followed by boost() and demand() and dropped
+	 as soon as all dependencies are resolved */
+      struct dependency_link {
+	 task_handle vertex;
+	 dependency_link* next;
+      };
+      void add_link(task_handle dependency) {
+	 if (!first_link) {
+	    first_link = std::move(dependency);
+	 } else {
+	    more_links = slots::create<dependency_link>(std::move(dependency),
+	       more_links);
+	 }
+      }
+      /* the links are visited by at most one thread at a time;
+	 returns false if they are already dropped */
+      bool lock_links() {
+	 unsigned int expected = links_open;
+	 while (!links.compare_exchange_weak(expected, links_visited,
+	       std::memory_order_acquire, std::memory_order_relaxed)) {
+	    if (expected == links_dropped) return false;
+	    if (expected == links_visited) std::this_thread::yield();
+	    expected = links_open;
+	 }
+	 return true;
+      }
+      /* the links are free'd by whoever comes last,
+	 the visitor or drop_links() */
+      void unlock_links() {
+	 unsigned int expected = links_visited;
+	 if (!links.compare_exchange_strong(expected, links_open,
+	       std::memory_order_release, std::memory_order_relaxed)) {
+	    free_links();
+	 }
       }
+      template<typename Visit>
+      void visit_links(Visit visit) {
+	 if (!lock_links()) return;
+	 if (first_link) visit(first_link);
+	 for (auto link = more_links; link; link = link->next) {
+	    visit(link->vertex);
+	 }
+	 unlock_links();
+      }
+      void drop_links() {
+	 if (links.exchange(links_dropped, std::memory_order_acq_rel) ==
+	       links_open) {
+	    free_links();
+	 }
+      }
+      void free_links() {
+	 first_link = nullptr;
+	 while (more_links) {
+	    auto next = more_links->next;
+	    slots::destroy(more_links); more_links = next;
+	 }
+      }
+      /* marks the stack of dependents as closed when we are finished */
+      static dependent* closed() {
+	 static dependent sentinel{nullptr, {}, nullptr};
+	 return &sentinel;
+      }
+
+      /* all transitions are triggered by the counter of dependencies
+	 left and the stack of dependents, hence a vertex needs no lock
+	 and the state is kept for the assertions only */
+      std::atomic<State> state{PREPARING};
+      std::atomic<bool> urgent{false}; /* somebody waits for us */
+      /* lazy vertices are enqueued by whoever sets the second
+	 of both bits, others are demanded from the beginning */
+      static constexpr unsigned int demanded = 1;
+      static constexpr unsigned int resolved = 2;
+      bool lazy = false;
+      std::atomic<unsigned int> lazy_state{demanded};
+      /* links to the vertices we depend on, see lock_links() */
+      static constexpr unsigned int links_open = 0;
+      static constexpr unsigned int links_visited = 1;
+      static constexpr unsigned int links_dropped = 2;
+      std::atomic<unsigned int> links{links_open};
+      task_handle first_link;
+      dependency_link* more_links = nullptr;
+      std::weak_ptr<runnable> origin; /* of a lazily attached root task */
+      /* while we are preparing, the number of dependencies left
+	 is biased such that it cannot drop to zero before
+	 finish_preparation publishes the registered dependencies */
+      static constexpr std::size_t preparing =
+	 std::size_t(1) << (sizeof(std::size_t) * 8 - 1);
+      std::atomic<std::size_t> dependencies_left{preparing};
+      std::size_t registered = 0; /* used during the preparatory phase */
+      std::atomic<dependent*> dependents{nullptr};
+      /* instrumentation */
+      const char* label = nullptr;
+      bool counted = false; /* considered by the counters */
+      bool sampled = false; /* latencies are to be recorded */
+      std::atomic<bool> sampled_dependents{false}; /* some are sampled */
+      std::uint64_t ready_time = 0;
+};
+
+/* notify the dependents of a finished task; a single dependent
+   is released immediately such that it can be handed off to
+   the current worker, otherwise this is done by a separate job */
+template<typename Release>
+void release_dependents(thread_pool& tp, Release release) {
+   if (!release.at_most_one()) {
+      submit_job(tp, [release]() {
+	 release();
+      });
+   } else if (auto& h = current_handoff(); h.active && !h.job) {
+      h.armed = true;
+      release();
+      h.armed = false;
+   } else {
+      release();
+   }
+}
 
+/* readiness of a result which is represented by a single word;
+   waiting threads announce themselves by setting the waiting bit
+   before they park at the word, hence the parking lot is
+   visited only if somebody actually has to sleep */
+class result_state {
+   public:
+      bool ready() const {
+	 return word.load(std::memory_order_acquire) & done;
+      }
+      /* must not be invoked before we are ready */
+      bool failed() const {
+	 return exception != nullptr;
+      }
+      void wait() const {
+	 auto w = word.load(std::memory_order_acquire);
+	 while (!(w & done)) {
+	    if (!(w & waiting) && !word.compare_exchange_weak(w, w | waiting,
+		  std::memory_order_acquire)) {
+	       continue;
+	    }
+	    if (!fibers::suspend(word, w | waiting)) {
+	       compensation::blocking section;
+	       parking_lot::park(&word, [this, w]() {
+		  return word.load(std::memory_order_relaxed) ==
+		     (w | waiting);
+	       });
+	    }
+	    w = word.load(std::memory_order_acquire);
+	 }
+      }
+      void rethrow() const {
+	 if (exception) std::rethrow_exception(exception);
+      }
+   protected:
+      void fail(std::exception_ptr e) {
+	 exception = std::move(e);
+      }
+      void publish() {
+	 if (word.exchange(done, std::memory_order_acq_rel) & waiting) {
+	    parking_lot::unpark_all(&word);
+	 }
+      }
    private:
-      std::mutex mutex;
-      State state = PREPARING;
-      std::function<void()> submit_task;
-      std::size_t dependencies_left = 0;
-      std::deque<task_handle> dependents;
+      static constexpr std::uint32_t done = 1;
+      static constexpr std::uint32_t waiting = 2;
+      mutable futex::word_type word{0};
+      std::exception_ptr exception;
 };
 
-/* create a chain of task handles in case of indirections */
+/* result of a task which is stored inline, i.e. within the
+   task record, and set exactly once by run */
+template<typename T>
+class result_slot: public result_state {
+   public:
+      result_slot() = default;
+      result_slot(const result_slot&) = delete;
+      result_slot& operator=(const result_slot&) = delete;
+      ~result_slot() {
+	 if (ready() && !failed()) value().~T();
+      }
+      template<typename F>
+      void run(F& f) {
+	 try {
+	    new (storage) T(f());
+	 } catch (...) {
+	    fail(std::current_exception());
+	 }
+	 publish();
+      }
+      const T& get() const {
+	 wait(); rethrow();
+	 return value();
+      }
+      /* null pointer if we are not ready yet */
+      const T* try_get() const {
+	 if (!ready()) return nullptr;
+	 rethrow();
+	 return &value();
+      }
+   private:
+      alignas(T) unsigned char storage[sizeof(T)];
+
+      const T& value() const {
+	 return *std::launder(reinterpret_cast<const T*>(storage));
+      }
+};
+/* results that are references are stored as pointers */
 template<typename T>
-auto fix_indirection(thread_pool& tp, task_handle handle,
-      std::shared_future<T> result) {
-   auto inner_th = std::make_shared<task_handle_rec>();
+class result_slot<T&>: public result_state {
+   public:
+      template<typename F>
+      void run(F& f) {
+	 try {
+	    pointer = std::addressof(f());
+	 } catch (...) {
+	    fail(std::current_exception());
+	 }
+	 publish();
+      }
+      T& get() const {
+	 wait(); rethrow();
+	 return *pointer;
+      }
+      T* try_get() const {
+	 if (!ready()) return nullptr;
+	 rethrow();
+	 return pointer;
+      }
+   private:
+      T* pointer = nullptr;
+};
+template<>
+class result_slot<void>: public result_state {
+   public:
+      template<typename F>
+      void run(F& f) {
+	 try {
+	    f();
+	 } catch (...) {
+	    fail(std::current_exception());
+	 }
+	 publish();
+      }
+};
+
+/* create a chain of task handles in case of indirections;
+   t is the task which delivers the nested task */
+template<typename Task>
+auto fix_indirection(thread_pool& tp, task_handle handle, Task t) {
+   auto inner_th = slots::make_shared<task_handle_rec>();
    inner_th->set_submit_task([=, &tp]() {
-      auto cleanup = inner_th->finish();
-      tp.submit([cleanup = std::move(cleanup)]() {
-	 cleanup();
-      });
+      release_dependents(tp, inner_th->finish());
    });
 
-   auto outer_th = std::make_shared<task_handle_rec>();
+   auto outer_th = slots::make_shared<task_handle_rec>();
    inner_th->add_dependency(outer_th);
-   outer_th->set_submit_task([=, &tp]() {
-      tp.submit([=,&tp]() {
-	 inner_th->add_dependency(result.get()->get_handle());
-	 inner_th->finish_preparation();
-	 auto cleanup = outer_th->finish();
-	 tp.submit([cleanup = std::move(cleanup)]() {
-	    cleanup();
-	 });
-      });
+   outer_th->set_job(tp, [=, &tp]() {
+      /* there is no nested task if the task failed or was cancelled */
+      task_handle nested;
+      if (!t->failed()) {
+	 nested = t->get()->get_handle();
+      }
+      inner_th->add_dependency(nested);
+      inner_th->finish_preparation();
+      release_dependents(tp, outer_th->finish());
    });
    outer_th->add_dependency(handle);
    outer_th->finish_preparation();
@@ -223,202 +2316,758 @@ auto fix_indirection(thread_pool& tp, task_handle handle,
 }
 
 /* we need this base class to offer the get_handle() method on a
-   non-templated class */
+   non-templated class;
+   root tasks, i.e. tasks without dependencies, are submitted
+   without a vertex (handle is null) which is created lazily
+   as soon as another task lists it as dependency;
+   a null handle is returned if the root task is already finished;
+   the job of a root task is kept by a runnable of its own which is
+   referenced by the task record such that it can be taken by the
+   urgent lane, see boost(); other tasks do not need it */
 class basic_task_rec {
    public:
       basic_task_rec(task_handle handle) :
-	 handle(handle), nested_handle(handle) {
+	 handle(handle), root(handle? ATTACHED: PENDING) {
       }
       virtual ~basic_task_rec() = default;
 
       task_handle get_handle() {
-	 return handle;
+	 if (root.load(std::memory_order_acquire) == ATTACHED) {
+	    return handle;
+	 }
+	 return attach_handle();
       }
       task_handle get_nested_handle() {
-	 return nested_handle;
+	 if (nested_handle) return nested_handle;
+	 return get_handle();
+      }
+      /* set the vertex which is finished when the nested task
+	 is finished, see fix_indirection */
+      void set_nested_handle(task_handle nested) {
+	 nested_handle = std::move(nested);
+      }
+      /* the job of a root task remains with us until it is taken
+	 by its token or, if somebody waits for us, by the urgent lane */
+      void set_origin(std::shared_ptr<runnable> job) {
+	 origin = std::move(job);
+      }
+      /* wait-free check whether the task (including the nested
+	 task, if any) is finished, i.e. whether its result is available;
+	 this neither locks nor waits and is hence suitable for polling */
+      virtual bool is_ready() const = 0;
+      /* to be invoked by the job of a root task when it is finished;
+	 returns the vertex that has to be finished, if any */
+      task_handle finish_root() {
+	 if (root.exchange(DONE, std::memory_order_acq_rel) == ATTACHED) {
+	    return handle;
+	 }
+	 return nullptr;
+      }
+      /* invoked by those who are about to wait for us */
+      void boost() const {
+	 switch (root.load(std::memory_order_acquire)) {
+	    case PENDING:
+	    case CREATING:
+	       urgent::push(origin);
+	       break;
+	    case ATTACHED:
+	       handle->demand();
+	       handle->boost();
+	       break;
+	    default:
+	       break;
+	 }
       }
    protected:
       task_handle handle;
       task_handle nested_handle;
+   private:
+      enum {PENDING, CREATING, ATTACHED, DONE};
+      std::atomic<int> root;
+      std::shared_ptr<runnable> origin; /* of root tasks only */
+
+      task_handle attach_handle() {
+	 int state = PENDING;
+	 while (!root.compare_exchange_weak(state, CREATING,
+	       std::memory_order_acquire)) {
+	    if (state == ATTACHED) return handle;
+	    if (state == DONE) return nullptr;
+	    if (state == CREATING) std::this_thread::yield();
+	    state = PENDING;
+	 }
+	 handle = task_handle_rec::submitted(origin);
+	 state = CREATING;
+	 if (root.compare_exchange_strong(state, ATTACHED,
+	       std::memory_order_release, std::memory_order_relaxed)) {
+	    return handle;
+	 }
+	 /* the task has been finished in the meantime */
+	 handle->finish()();
+	 return nullptr;
+      }
 };
 
 /* tasks consist of a task handle (for the interdependency graph)
-   and a future object that delivers the return value of
-   the corresponding task */
+   and a result slot that delivers the return value of
+   the corresponding task; the result is waited for without
+   any lock as the slot is set exactly once */
 template<typename T>
 class task_rec: public basic_task_rec {
    public:
-      task_rec(thread_pool& tp,
-	    task_handle handle, std::shared_future<T> result) :
-	    basic_task_rec(handle), result(result) {
-	 assert(result.valid());
+      task_rec(task_handle handle) : basic_task_rec(handle) {
       }
       void join() const {
-	 std::lock_guard lock(mutex);
-	 result.wait();
+	 if (!result.ready()) {
+	    boost(); result.wait();
+	 }
       }
       const T& get() const {
-	 std::lock_guard lock(mutex);
+	 join();
 	 return result.get();
       }
       const T& get_value() const {
-	 std::lock_guard lock(mutex);
+	 join();
 	 return result.get();
       }
+      bool is_ready() const override {
+	 return result.ready();
+      }
+      /* return the value without waiting if the task is finished,
+	 otherwise a null pointer; the pointer is non-const
+	 for tasks that return non-const references */
+      std::add_pointer_t<const T> try_get() const {
+	 return result.try_get();
+      }
+      bool failed() const {
+	 return result.failed();
+      }
+      template<typename F>
+      void run(F& f) {
+	 result.run(f);
+      }
    private:
-      mutable std::mutex mutex;
-      std::shared_future<T> result;
+      result_slot<T> result;
 };
 /* special case where we eliminate one level of indirection */
 template<typename T>
 class task_rec<task<T>>: public basic_task_rec {
    public:
-      task_rec(thread_pool& tp,
-	    task_handle handle, std::shared_future<task<T>> result) :
-	    basic_task_rec(handle), result(result) {
-	 assert(result.valid());
-	 nested_handle = fix_indirection(tp, handle, result);
+      task_rec(task_handle handle) : basic_task_rec(handle) {
       }
-
       void join() const {
-	 std::lock_guard lock(mutex);
-	 auto nested_result = result.get();
-	 nested_result->join();
+	 get()->join();
       }
       const task<T>& get() const {
-	 std::lock_guard lock(mutex);
+	 if (!result.ready()) boost();
 	 return result.get();
       }
       const T& get_value() const {
-	 std::lock_guard lock(mutex);
-	 auto nested_result = result.get();
-	 return nested_result->get_value();
+	 return get()->get_value();
+      }
+      bool is_ready() const override {
+	 return result.ready() && (result.failed() ||
+	    result.get()->is_ready());
+      }
+      std::add_pointer_t<const T> try_get() const {
+	 if (!is_ready()) return nullptr;
+	 return result.get()->try_get();
+      }
+      bool failed() const {
+	 return result.failed();
+      }
+      template<typename F>
+      void run(F& f) {
+	 result.run(f);
       }
    private:
-      mutable std::mutex mutex;
-      std::shared_future<task<T>> result;
+      result_slot<task<T>> result;
 };
 /* special case of task_rec for void where
    get() must not return void& */
 template<>
 class task_rec<void>: public basic_task_rec {
    public:
-      task_rec(thread_pool& tp,
-	    task_handle handle, std::shared_future<void> result) :
-	    basic_task_rec(handle), result(result) {
-	 assert(result.valid());
+      task_rec(task_handle handle) : basic_task_rec(handle) {
       }
       void join() const {
-	 std::lock_guard lock(mutex);
-	 result.wait();
+	 if (!result.ready()) {
+	    boost(); result.wait();
+	 }
       }
       void get() const {
 	 join();
       }
+      bool is_ready() const override {
+	 return result.ready();
+      }
+      bool try_get() const {
+	 return is_ready();
+      }
+      bool failed() const {
+	 return result.failed();
+      }
+      template<typename F>
+      void run(F& f) {
+	 result.run(f);
+      }
    private:
-      mutable std::mutex mutex;
-      std::shared_future<void> result;
+      result_slot<void> result;
 };
 template<>
 class task_rec<task<void>>: public basic_task_rec {
    public:
-      task_rec(thread_pool& tp,
-	    task_handle handle, std::shared_future<task<void>> result) :
-	    basic_task_rec(handle), result(result) {
-	 assert(result.valid());
-	 nested_handle = fix_indirection(tp, handle, result);
+      task_rec(task_handle handle) : basic_task_rec(handle) {
+      }
+      void join() const {
+	 get()->join();
+      }
+      const task<void>& get() const {
+	 if (!result.ready()) boost();
+	 return result.get();
+      }
+      bool is_ready() const override {
+	 return result.ready() && (result.failed() ||
+	    result.get()->is_ready());
+      }
+      bool try_get() const {
+	 return is_ready();
+      }
+      bool failed() const {
+	 return result.failed();
+      }
+      template<typename F>
+      void run(F& f) {
+	 result.run(f);
+      }
+   private:
+      result_slot<task<void>> result;
+};
+
+template<typename T>
+struct is_task: std::false_type {};
+template<typename T>
+struct is_task<task<T>>: std::true_type {};
+
+/* std::function, which is used for the jobs, requires copyable
+   function objects, hence other function objects are shared */
+template<typename F>
+auto copyable(F&& f) {
+   using Function = std::decay_t<F>;
+   if constexpr (std::is_copy_constructible_v<Function>) {
+      return Function(std::forward<F>(f));
+   } else {
+      auto shared = slots::make_shared<Function>(std::forward<F>(f));
+      return [shared]() mutable {
+	 return (*shared)();
+      };
+   }
+}
+
+/* dispatcher of a task arena which runs its jobs on a limited
+   number of slots, i.e. by at most that many workers of its pool
+   at a time; a slot is a job in the pool that runs the queued jobs
+   of the arena until none is left; if the slots of an arena are
+   all occupied, it borrows an idle slot of another arena of the
+   same pool that lends its slots; borrowed slots return to their
+   lenders as soon as the lenders have jobs of their own */
+class arena_state: public dispatcher {
+   public:
+      arena_state(thread_pool& tp, unsigned int slots, bool lend) :
+	    tp(tp), slots(slots? slots: 1), lend(lend),
+	    lenders(registry.obtain(tp, []() {
+	       return std::make_shared<lender_list>();
+	    })) {
+	 if (lend) {
+	    std::lock_guard lock(lenders->mutex);
+	    lenders->arenas.push_back(this);
+	    lenders->size.store(lenders->arenas.size(),
+	       std::memory_order_relaxed);
+	 }
+      }
+      ~arena_state() {
+	 if (lend) {
+	    std::lock_guard lock(lenders->mutex);
+	    auto& arenas = lenders->arenas;
+	    arenas.erase(std::find(arenas.begin(), arenas.end(), this));
+	    lenders->size.store(arenas.size(), std::memory_order_relaxed);
+	 }
+      }
+      thread_pool& get_pool() const {
+	 return tp;
+      }
+      void dispatch(std::function<void()> job) override {
+	 bool occupied = false;
+	 {
+	    std::lock_guard lock(mutex);
+	    jobs.push_back(std::move(job));
+	    if (running < slots) {
+	       ++running; occupied = true;
+	    }
+	 }
+	 if (occupied) {
+	    retain(); retain();
+	    start(this, this);
+	 } else if (lenders->size.load(std::memory_order_relaxed) > 0) {
+	    borrow();
+	 }
+      }
+   private:
+      /* the lending arenas of a pool which is shared
+	 by all arenas of the pool */
+      struct lender_list {
+	 std::mutex mutex;
+	 std::vector<arena_state*> arenas;
+	 std::atomic<std::size_t> size{0};
+      };
+      static inline pool_registry<lender_list> registry;
+
+      thread_pool& tp;
+      const unsigned int slots;
+      const bool lend;
+      std::shared_ptr<lender_list> lenders;
+      mutex_type<pool_lock> mutex;
+      std::deque<std::function<void()>> jobs;
+      unsigned int running = 0; /* occupied slots, including lent ones */
+
+      /* a slot of owner is started which serves guest
+	 when owner has nothing to do; both are retained */
+      void start(arena_state* owner, arena_state* guest) {
+	 submit_job(tp, [owner, guest]() {
+	    work(owner, guest);
+	 });
+      }
+      std::function<void()> take() {
+	 std::lock_guard lock(mutex);
+	 if (jobs.empty()) return nullptr;
+	 auto job = std::move(jobs.front());
+	 jobs.pop_front();
+	 return job;
+      }
+      static void work(arena_state* owner, arena_state* guest) {
+	 for (;;) {
+	    auto job = owner->take();
+	    if (!job && guest != owner) job = guest->take();
+	    if (!job) {
+	       /* jobs of owner that were queued after our check
+		  saw an occupied slot and are ours */
+	       std::lock_guard lock(owner->mutex);
+	       if (owner->jobs.empty()) {
+		  --owner->running; break;
+	       }
+	       continue;
+	    }
+	    job();
+	 }
+	 owner->release(); guest->release();
+      }
+      /* occupy an idle slot of a lending arena of our pool */
+      void borrow() {
+	 std::lock_guard lock(lenders->mutex);
+	 for (auto lender: lenders->arenas) {
+	    if (lender == this) continue;
+	    {
+	       std::lock_guard lender_lock(lender->mutex);
+	       if (lender->running == lender->slots ||
+		     !lender->jobs.empty() || !lender->try_retain()) {
+		  continue;
+	       }
+	       ++lender->running;
+	    }
+	    retain();
+	    start(lender, this);
+	    return;
+	 }
+      }
+};
+
+/* weighted fair scheduling of task groups: every task group with
+   a weight has its own queue and every job queued there is
+   represented by a token in the thread pool; a token does not run
+   the job it was submitted for but selects a job by deficit round
+   robin among the non-empty queues of its pool, i.e. a queue with
+   weight w delivers up to w jobs in a row before the next queue is
+   served; jobs count as units as their costs are not known;
+   schedulers are never free'd as tokens may still refer to them */
+namespace fair {
+
+class queue;
+
+struct scheduler {
+   thread_pool* pool;
+   mutex_type<pool_lock> mutex;
+   std::deque<queue*> active; /* non-empty queues, retained */
+
+   void push(queue* q, std::function<void()> job);
+   void run();
+};
+
+inline std::mutex schedulers_mutex;
+inline std::vector<scheduler*>& schedulers = *new std::vector<scheduler*>();
+
+inline scheduler* lookup(thread_pool& tp) {
+   std::lock_guard lock(schedulers_mutex);
+   for (auto s: schedulers) {
+      if (s->pool == &tp) return s;
+   }
+   auto s = new scheduler();
+   s->pool = &tp;
+   schedulers.push_back(s);
+   return s;
+}
+
+class queue: public dispatcher {
+   public:
+      queue(thread_pool& tp, unsigned int weight) :
+	    s(*lookup(tp)), weight(weight? weight: 1) {
       }
-      void join() const {
-	 std::lock_guard lock(mutex);
-	 auto nested_result = result.get();
-	 nested_result->join();
+      void dispatch(std::function<void()> job) override {
+	 s.push(this, std::move(job));
       }
-      const task<void>& get() const {
-	 std::lock_guard lock(mutex);
-	 return result.get();
+      void set_weight(unsigned int w) {
+	 std::lock_guard lock(s.mutex);
+	 weight = w? w: 1;
       }
    private:
-      mutable std::mutex mutex;
-      std::shared_future<task<void>> result;
+      friend struct scheduler;
+      scheduler& s;
+      /* protected by the mutex of the scheduler */
+      unsigned int weight;
+      unsigned int deficit = 0; /* jobs left in the current round */
+      bool active = false;
+      std::deque<std::function<void()>> jobs;
 };
 
-template<typename T, typename Iterator, typename PostAction>
-auto schedule_submission(thread_pool& tp,
+inline void scheduler::push(queue* q, std::function<void()> job) {
+   {
+      std::lock_guard lock(mutex);
+      q->jobs.push_back(std::move(job));
+      if (!q->active) {
+	 q->active = true;
+	 q->retain();
+	 active.push_back(q);
+      }
+   }
+   submit_job(*pool, [this]() {
+      run();
+   });
+}
+
+/* there are as many tokens as queued jobs */
+inline void scheduler::run() {
+   std::function<void()> job;
+   queue* drained = nullptr;
+   {
+      std::lock_guard lock(mutex);
+      assert(!active.empty());
+      auto q = active.front();
+      if (q->deficit == 0) q->deficit = q->weight;
+      job = std::move(q->jobs.front());
+      q->jobs.pop_front();
+      --q->deficit;
+      if (q->jobs.empty()) {
+	 active.pop_front();
+	 q->active = false; q->deficit = 0;
+	 drained = q;
+      } else if (q->deficit == 0) {
+	 active.pop_front();
+	 active.push_back(q);
+      }
+   }
+   if (drained) drained->release();
+   job();
+}
+
+} // namespace fair
+
+/* the result of f is stored in the task record which is
+   kept alive by the job until it is executed;
+   via is the dispatcher of the task arena, if any */
+template<typename F, typename Iterator, typename PostAction>
+auto schedule_submission(thread_pool& tp, dispatcher* via,
+      const task_attributes& attributes,
       Iterator begin, Iterator end,
-      std::shared_ptr<std::packaged_task<T()>> ptask,
-      PostAction post_action) {
-   auto th = std::make_shared<task_handle_rec>();
-   for (auto it = begin; it != end; ++it) {
-      th->add_dependency((*it)->get_nested_handle());
-   }
-   th->set_submit_task([=,&tp]() {
-      tp.submit([=,&tp]() {
-	 (*ptask)(); 
-	 auto cleanup = th->finish();
-	 tp.submit([cleanup = std::move(cleanup)]() {
-	    cleanup();
-	 });
+      F&& function, PostAction post_action) {
+   using T = decltype(function());
+   auto f = copyable(std::forward<F>(function));
+   /* tasks which deliver tasks are never lazy as their
+      vertices are linked to the vertices of the nested tasks */
+   bool lazy = attributes.lazy && !is_task<T>::value;
+   if (begin == end && !lazy &&
+	 !metrics_enabled.load(std::memory_order_relaxed)) {
+      /* root task that bypasses the graph unless it is needed */
+      auto t = slots::make_shared<task_rec<T>>(nullptr);
+      auto origin = slots::make_shared<runnable>();
+      origin->set(&tp, [=,&tp]() mutable {
+	 t->run(f);
+	 if (auto th = t->finish_root()) {
+	    release_dependents(tp, th->finish());
+	 }
+	 post_action();
+      });
+      origin->set_dispatcher(via);
+      t->set_origin(origin);
+      if constexpr (is_task<T>::value) {
+	 t->set_nested_handle(fix_indirection(tp, t->get_handle(), t));
+      }
+      auto token = [origin]() {
+	 if (auto job = origin->take()) job();
+      };
+      if (via) {
+	 via->dispatch(std::move(token));
+      } else {
+	 submit_job(tp, std::move(token));
+      }
+      return t;
+   }
+   auto th = slots::make_shared<task_handle_rec>();
+   th->set_attributes(attributes);
+   th->set_dispatcher(via);
+   if (lazy) th->set_lazy();
+   th->add_dependencies(begin, end);
+   auto t = slots::make_shared<task_rec<T>>(th);
+   if constexpr (is_task<T>::value) {
+      t->set_nested_handle(fix_indirection(tp, th, t));
+   }
+   if (lazy) {
+      /* a lazy job must not keep its vertex and task record alive
+	 as they are possibly never demanded; while the job runs,
+	 the vertex is kept alive by enqueue();
+	 the result is dropped if nobody holds the task record */
+      auto vertex = th.get();
+      std::weak_ptr<task_rec<T>> record = t;
+      th->set_job(tp, [=,&tp]() mutable {
+	 auto start_time = vertex->start_execution();
+	 if (auto t = record.lock()) {
+	    t->run(f);
+	 } else {
+	    try {
+	       f();
+	    } catch (...) {
+	    }
+	 }
+	 vertex->end_execution(start_time);
+	 release_dependents(tp, vertex->finish());
 	 post_action();
       });
+      th->finish_preparation();
+      return t;
+   }
+   th->set_job(tp, [=,&tp]() mutable {
+      auto start_time = th->start_execution();
+      t->run(f);
+      th->end_execution(start_time);
+      release_dependents(tp, th->finish());
+      post_action();
    });
    th->finish_preparation();
-   auto t = std::make_shared<task_rec<T>>(tp, th, ptask->get_future());
    return t;
 }
 
 } // namespace impl
 
 template<typename T> using task = impl::task<T>;
+/* common base of all tasks, useful for dependency lists
+   with tasks of different types */
+using basic_task = impl::basic_task;
+
+/* thrown by the get methods of tasks which were cancelled */
+class task_cancelled: public std::exception {
+   public:
+      const char* what() const noexcept override {
+	 return "task cancelled";
+      }
+};
+
+/* policies of task_group::drain */
+enum class drain_policy {
+   finish_all, /* wait until all tasks are finished */
+   cancel_waiting, /* cancel all tasks which have not been started yet */
+   abort, /* like cancel_waiting but wait until a deadline at most */
+};
+
+/* task arenas restrict the tasks bound to them to a number of
+   slots, i.e. at most that many workers of the pool run them at a
+   time, such that they neither occupy nor queue ahead of the other
+   workers of the pool; if lend is true, idle slots are lent to
+   other task arenas of the same pool whose slots are all occupied;
+   tasks are bound to an arena by submitting them to it or to a
+   task group of it; the arena may be destructed before its tasks */
+class task_arena {
+   public:
+      task_arena(thread_pool& tp, unsigned int slots, bool lend = false) :
+	    state(new impl::arena_state(tp, slots, lend)) {
+      }
+      ~task_arena() {
+	 state->release();
+      }
+      task_arena(const task_arena&) = delete;
+      task_arena& operator=(const task_arena&) = delete;
+      thread_pool& get_pool() const {
+	 return state->get_pool();
+      }
+      impl::dispatcher* get_dispatcher() const {
+	 return state;
+      }
+   private:
+      impl::arena_state* state;
+};
 
 /* task groups are used for synchronization
    as their destructor waits until all tasks
    of this task group are finished */
 class task_group {
    public:
-      task_group(thread_pool& tp) : tp(tp) {
+      task_group(thread_pool& tp) :
+	    tp(tp), state(std::make_shared<group_state>()) {
+      }
+      /* the tasks of this group are bound to the given arena */
+      task_group(task_arena& arena) :
+	    tp(arena.get_pool()), via(arena.get_dispatcher()),
+	    state(std::make_shared<group_state>()) {
+	 via->retain();
+      }
+      /* the tasks of this group are scheduled fairly among the tasks
+	 of the other task groups of the pool which have a weight, i.e.
+	 a group with weight w gets up to w jobs run in a row */
+      task_group(thread_pool& tp, unsigned int weight) :
+	    tp(tp), weighted(new impl::fair::queue(tp, weight)),
+	    state(std::make_shared<group_state>()) {
+	 via = weighted;
       }
       ~task_group() {
-	 join();
+	 if (!abandoned) join();
+	 if (via) via->release();
+      }
+      task_group(const task_group&) = delete;
+      task_group& operator=(const task_group&) = delete;
+      /* change the weight of a group which was constructed with
+	 a weight; returns false for other groups */
+      bool set_weight(unsigned int weight) {
+	 if (!weighted) return false;
+	 weighted->set_weight(weight);
+	 return true;
       }
       /* wait until all tasks of this task group are finished */
       void join() {
-	 std::unique_lock lock(mutex);
-	 while (active > 0) {
-	    cv.wait(lock);
+	 state->wait_until(impl::parking_lot::clock::time_point::max());
+      }
+      /* drain the task group according to the given policy;
+	 cancelled tasks are not executed but finished nonetheless,
+	 such that their dependents are released and cancelled
+	 as well if they belong to this task group;
+	 in case of abort, we wait for the tasks which are still
+	 running until the timeout at most and return false if they
+	 did not finish in time; the task group is then abandoned,
+	 i.e. its destructor does not wait for these tasks */
+      bool drain(drain_policy policy,
+	    std::chrono::nanoseconds timeout =
+	       std::chrono::nanoseconds::max()) {
+	 if (policy != drain_policy::finish_all) {
+	    state->cancelled.store(true, std::memory_order_relaxed);
+	 }
+	 if (policy != drain_policy::abort ||
+	       timeout == std::chrono::nanoseconds::max()) {
+	    join();
+	    return true;
+	 }
+	 auto deadline = impl::parking_lot::clock::now() + timeout;
+	 if (!state->wait_until(deadline)) {
+	    abandoned = true;
+	    return false;
 	 }
+	 return true;
       }
       template<typename F, typename... Parameters>
       auto submit(std::initializer_list<impl::basic_task> dependencies,
 	    F&& task_function, Parameters&&... parameters) {
-	 return submit(dependencies.begin(), dependencies.end(),
+	 return submit(task_attributes{},
+	    dependencies.begin(), dependencies.end(),
 	    std::forward<F>(task_function),
 	    std::forward<Parameters>(parameters)...);
       }
       template<typename Iterator, typename F, typename... Parameters>
       auto submit(Iterator begin, Iterator end,
 	    F&& task_function, Parameters&&... parameters) {
+	 return submit(task_attributes{}, begin, end,
+	    std::forward<F>(task_function),
+	    std::forward<Parameters>(parameters)...);
+      }
+      template<typename F, typename... Parameters>
+      auto submit(const task_attributes& attributes,
+	    std::initializer_list<impl::basic_task> dependencies,
+	    F&& task_function, Parameters&&... parameters) {
+	 return submit(attributes, dependencies.begin(), dependencies.end(),
+	    std::forward<F>(task_function),
+	    std::forward<Parameters>(parameters)...);
+      }
+      template<typename Iterator, typename F, typename... Parameters>
+      auto submit(const task_attributes& attributes,
+	    Iterator begin, Iterator end,
+	    F&& task_function, Parameters&&... parameters) {
 	 using T = decltype(task_function(parameters...));
-	 auto f = std::make_shared<std::packaged_task<T()>>(
-	    std::bind(std::forward<F>(task_function),
-	       std::forward<Parameters>(parameters)...)
-	 );
-	 {
-	    std::lock_guard lock(mutex);
-	    ++active;
-	 }
-	 auto t = impl::schedule_submission(tp, begin, end, f, [this]() {
-	    std::lock_guard lock(mutex);
-	    if (--active == 0) {
-	       cv.notify_all();
+	 auto f = [state = state, g = std::bind(std::forward<F>(task_function),
+	       std::forward<Parameters>(parameters)...)]() mutable -> T {
+	    if (state->cancelled.load(std::memory_order_relaxed)) {
+	       throw task_cancelled();
 	    }
+	    return g();
+	 };
+	 /* we wait for all our tasks, hence they cannot be lazy */
+	 auto group_attributes = attributes;
+	 group_attributes.lazy = false;
+	 state->active.fetch_add(1, std::memory_order_relaxed);
+	 auto t = impl::schedule_submission(tp, via,
+	       group_attributes, begin, end,
+	       std::move(f), [state = state]() {
+	    state->finish();
 	 });
 	 return t;
       }
    private:
-      std::mutex mutex;
-      std::condition_variable cv;
+      /* shared with the tasks as they may outlive an abandoned group;
+	 joining threads set the waiting bit of the counter of
+	 active tasks and park at it, see impl::parking_lot */
+      struct group_state {
+	 using clock = impl::parking_lot::clock;
+	 static constexpr std::size_t waiting =
+	    std::size_t(1) << (sizeof(std::size_t) * 8 - 1);
+	 std::atomic<std::size_t> active{0}; /* number of still running tasks */
+	 std::atomic<bool> cancelled{false};
+
+	 void finish() {
+	    if (active.fetch_sub(1, std::memory_order_acq_rel) ==
+		  (waiting | 1)) {
+	       auto expected = waiting;
+	       active.compare_exchange_strong(expected, 0,
+		  std::memory_order_relaxed);
+	       impl::parking_lot::unpark_all(&active);
+	    }
+	 }
+	 /* returns false if the deadline was reached before
+	    all tasks were finished */
+	 bool wait_until(clock::time_point deadline) {
+	    auto n = active.load(std::memory_order_acquire);
+	    while (n & ~waiting) {
+	       if (clock::now() >= deadline) return false;
+	       if (!(n & waiting) && !active.compare_exchange_weak(n,
+		     n | waiting, std::memory_order_acquire)) {
+		  continue;
+	       }
+	       impl::compensation::blocking section;
+	       impl::parking_lot::park_until(&active, [this, n]() {
+		  return active.load(std::memory_order_relaxed) ==
+		     (n | waiting);
+	       }, deadline);
+	       n = active.load(std::memory_order_acquire);
+	    }
+	    return true;
+	 }
+      };
       thread_pool& tp;
-      std::size_t active = 0; /* number of still running tasks */
+      impl::fair::queue* weighted = nullptr;
+      impl::dispatcher* via = nullptr;
+      std::shared_ptr<group_state> state;
+      bool abandoned = false;
 };
 
 /* submission front-end where the dependencies are
@@ -438,14 +3087,657 @@ template<typename F, typename Iterator, typename... Parameters>
 auto submit(thread_pool& tp,
       Iterator begin, Iterator end,
       F&& task_function, Parameters&&... parameters) {
-   using T = decltype(task_function(parameters...));
-   auto f = std::make_shared<std::packaged_task<T()>>(
+   return submit(tp, task_attributes{}, begin, end,
+      std::forward<F>(task_function),
+      std::forward<Parameters>(parameters)...);
+}
+
+/* submission front-ends with explicitly given task attributes */
+template<typename F, typename... Parameters>
+auto submit(thread_pool& tp, const task_attributes& attributes,
+      std::initializer_list<impl::basic_task> dependencies,
+      F&& task_function, Parameters&&... parameters) {
+   return submit(tp, attributes, dependencies.begin(), dependencies.end(),
+      std::forward<F>(task_function),
+      std::forward<Parameters>(parameters)...);
+}
+
+template<typename F, typename Iterator, typename... Parameters>
+auto submit(thread_pool& tp, const task_attributes& attributes,
+      Iterator begin, Iterator end,
+      F&& task_function, Parameters&&... parameters) {
+   return impl::schedule_submission(tp, nullptr, attributes, begin, end,
+      std::bind(std::forward<F>(task_function),
+	 std::forward<Parameters>(parameters)...),
+      [](){});
+}
+
+/* submission front-ends for tasks which are bound to a task arena */
+template<typename F, typename... Parameters>
+auto submit(task_arena& arena,
+      std::initializer_list<impl::basic_task> dependencies,
+      F&& task_function, Parameters&&... parameters) {
+   return submit(arena, task_attributes{},
+      dependencies.begin(), dependencies.end(),
+      std::forward<F>(task_function),
+      std::forward<Parameters>(parameters)...);
+}
+
+template<typename F, typename Iterator, typename... Parameters>
+auto submit(task_arena& arena,
+      Iterator begin, Iterator end,
+      F&& task_function, Parameters&&... parameters) {
+   return submit(arena, task_attributes{}, begin, end,
+      std::forward<F>(task_function),
+      std::forward<Parameters>(parameters)...);
+}
+
+template<typename F, typename... Parameters>
+auto submit(task_arena& arena, const task_attributes& attributes,
+      std::initializer_list<impl::basic_task> dependencies,
+      F&& task_function, Parameters&&... parameters) {
+   return submit(arena, attributes, dependencies.begin(), dependencies.end(),
+      std::forward<F>(task_function),
+      std::forward<Parameters>(parameters)...);
+}
+
+template<typename F, typename Iterator, typename... Parameters>
+auto submit(task_arena& arena, const task_attributes& attributes,
+      Iterator begin, Iterator end,
+      F&& task_function, Parameters&&... parameters) {
+   return impl::schedule_submission(arena.get_pool(), arena.get_dispatcher(),
+      attributes, begin, end,
       std::bind(std::forward<F>(task_function),
-	 std::forward<Parameters>(parameters)...)
-   );
-   return impl::schedule_submission(tp, begin, end, f, [](){});
+	 std::forward<Parameters>(parameters)...),
+      [](){});
+}
+
+/* graphs of void tasks that are constructed in bulk before
+   they are submitted; this permits optimizations of the
+   whole graph before any of its tasks is submitted */
+class graph {
+   public:
+      using node = std::size_t;
+
+      /* add a task with the given dependencies which must
+	 have been added before; returns its node */
+      template<typename F>
+      node add(std::initializer_list<node> dependencies, F&& f) {
+	 return add(dependencies.begin(), dependencies.end(),
+	    std::forward<F>(f));
+      }
+      template<typename Iterator, typename F>
+      node add(Iterator begin, Iterator end, F&& f) {
+	 vertex v;
+	 v.functions.emplace_back(std::forward<F>(f));
+	 for (auto it = begin; it != end; ++it) {
+	    assert(*it < vertices.size());
+	    v.dependencies.push_back(find(*it));
+	 }
+	 v.owner = vertices.size();
+	 vertices.push_back(std::move(v));
+	 return vertices.size() - 1;
+      }
+      /* number of tasks that were added */
+      std::size_t size() const {
+	 return vertices.size();
+      }
+      /* number of jobs the graph is executed with */
+      std::size_t units() const {
+	 std::size_t count = 0;
+	 for (node v = 0; v < vertices.size(); ++v) {
+	    if (vertices[v].owner == v) ++count;
+	 }
+	 return count;
+      }
+
+      /* remove duplicate dependencies and dependencies which are
+	 implied by other dependencies, e.g. A->C if A->B->C exists;
+	 this is best done before fuse_chains as redundant edges
+	 prevent fusions; returns the number of removed edges */
+      std::size_t reduce_edges() {
+	 std::size_t removed = 0;
+	 std::vector<node> mark(vertices.size(), vertices.size());
+	 std::vector<node> kept;
+	 std::vector<node> stack;
+	 for (node v = 0; v < vertices.size(); ++v) {
+	    auto& dependencies = vertices[v].dependencies;
+	    if (vertices[v].owner != v || dependencies.empty()) continue;
+	    for (auto& d: dependencies) {
+	       d = find(d);
+	    }
+	    /* as nodes are numbered in topological order, a dependency
+	       can be implied by dependencies with higher numbers only */
+	    std::sort(dependencies.begin(), dependencies.end(),
+	       std::greater<node>());
+	    auto lowest = dependencies.back();
+	    kept.clear();
+	    for (auto d: dependencies) {
+	       if (mark[d] == v) {
+		  ++removed; continue;
+	       }
+	       kept.push_back(d);
+	       /* mark d and all its ancestors that could be
+		  among the remaining dependencies */
+	       mark[d] = v;
+	       stack.push_back(d);
+	       while (!stack.empty()) {
+		  auto u = stack.back(); stack.pop_back();
+		  for (auto w: vertices[u].dependencies) {
+		     w = find(w);
+		     if (w < lowest || mark[w] == v) continue;
+		     mark[w] = v;
+		     stack.push_back(w);
+		  }
+	       }
+	    }
+	    dependencies.assign(kept.begin(), kept.end());
+	 }
+	 return removed;
+      }
+
+      /* fuse every task that has a single dependency into its
+	 dependency if it is the only dependent of it, i.e.
+	 linear chains are executed as one job;
+	 returns the number of tasks that have been fused */
+      std::size_t fuse_chains() {
+	 std::vector<std::size_t> dependents(vertices.size());
+	 for (node v = 0; v < vertices.size(); ++v) {
+	    if (vertices[v].owner != v) continue;
+	    for (auto d: vertices[v].dependencies) {
+	       ++dependents[find(d)];
+	    }
+	 }
+	 std::size_t fused = 0;
+	 for (node v = 0; v < vertices.size(); ++v) {
+	    auto& vertex = vertices[v];
+	    if (vertex.owner != v || vertex.dependencies.size() != 1) {
+	       continue;
+	    }
+	    auto u = find(vertex.dependencies.front());
+	    if (dependents[u] != 1) continue;
+	    /* v is the only dependent of u and depends on u only */
+	    auto& predecessor = vertices[u];
+	    for (auto& f: vertex.functions) {
+	       predecessor.functions.push_back(std::move(f));
+	    }
+	    vertex.functions.clear();
+	    vertex.dependencies.clear();
+	    vertex.owner = u;
+	    dependents[u] = dependents[v];
+	    ++fused;
+	 }
+	 return fused;
+      }
+
+      /* submit all tasks of the graph; the returned task is
+	 finished when all tasks of the graph are finished */
+      task<void> submit(thread_pool& tp) const {
+	 std::vector<task<void>> tasks(vertices.size());
+	 std::vector<bool> has_dependents(vertices.size());
+	 std::vector<basic_task> dependencies;
+	 for (node v = 0; v < vertices.size(); ++v) {
+	    auto& vertex = vertices[v];
+	    if (vertex.owner != v) continue;
+	    dependencies.clear();
+	    for (auto d: vertex.dependencies) {
+	       auto u = find(d);
+	       dependencies.push_back(tasks[u]);
+	       has_dependents[u] = true;
+	    }
+	    tasks[v] = mt::submit(tp, dependencies.begin(), dependencies.end(),
+	       [functions = vertex.functions]() {
+		  for (auto& f: functions) f();
+	       });
+	 }
+	 dependencies.clear();
+	 for (node v = 0; v < vertices.size(); ++v) {
+	    if (vertices[v].owner == v && !has_dependents[v]) {
+	       dependencies.push_back(tasks[v]);
+	    }
+	 }
+	 return mt::submit(tp, dependencies.begin(), dependencies.end(),
+	    []() {});
+      }
+      /* submit all tasks of the graph and wait for them */
+      void run(thread_pool& tp) const {
+	 submit(tp)->join();
+      }
+
+   private:
+      struct vertex {
+	 std::vector<std::function<void()>> functions; /* in this order */
+	 std::vector<node> dependencies;
+	 node owner; /* the vertex this vertex was fused into, or itself */
+      };
+      std::vector<vertex> vertices;
+
+      node find(node v) const {
+	 while (vertices[v].owner != v) {
+	    v = vertices[v].owner;
+	 }
+	 return v;
+      }
+};
+
+/* configuration of the execution of tasks on fibers which is
+   available if MT_TASK_FIBERS is defined and then enabled by default;
+   the stack size applies to fibers created from now on */
+namespace fibers {
+
+inline bool enable(std::size_t stack_size = 128 * 1024) {
+#ifdef MT_TASK_FIBERS
+   impl::fibers::stack_size.store(stack_size, std::memory_order_relaxed);
+   impl::fibers::enabled.store(true, std::memory_order_relaxed);
+   return true;
+#else
+   return false;
+#endif
+}
+inline void disable() {
+#ifdef MT_TASK_FIBERS
+   impl::fibers::enabled.store(false, std::memory_order_relaxed);
+#endif
+}
+inline bool enabled() {
+#ifdef MT_TASK_FIBERS
+   return impl::fibers::enabled.load(std::memory_order_relaxed);
+#else
+   return false;
+#endif
+}
+
+} // namespace fibers
+
+/* compensates workers of the given pool which block in a wait
+   of the task layer or within a blocking_section by up to
+   max_workers additional threads which retire as soon as the
+   blocking ends; the compensation ends with the lifetime of this
+   object whose destructor waits for the compensating threads to
+   retire, hence it must be destructed before the pool;
+   a pool is compensated by at most one object at a time */
+class blocking_compensation {
+   public:
+      blocking_compensation(thread_pool& tp, unsigned int max_workers) :
+	    state(std::make_shared<impl::compensation::pool_state>()) {
+	 state->max_workers = max_workers;
+	 if (!impl::compensation::registry.add(tp, state)) {
+	    throw std::invalid_argument("pool is already compensated");
+	 }
+      }
+      ~blocking_compensation() {
+	 impl::compensation::registry.remove(state.get());
+	 impl::compensation::close(*state);
+      }
+      blocking_compensation(const blocking_compensation&) = delete;
+      blocking_compensation& operator=(const blocking_compensation&) = delete;
+   private:
+      std::shared_ptr<impl::compensation::pool_state> state;
+};
+
+/* the lifetime of a blocking_section object marks user code
+   of a task that may block, e.g. due to I/O */
+class blocking_section {
+   public:
+      blocking_section() = default;
+      blocking_section(const blocking_section&) = delete;
+      blocking_section& operator=(const blocking_section&) = delete;
+   private:
+      impl::compensation::blocking section;
+};
+
+/* a group of cooperating thread pools where every pool prefers
+   its own jobs but idle workers of a pool may run the queued jobs
+   of its siblings according to their balancing_rules;
+   the number of workers of a pool must be given as the thread pools
+   do not tell it; dependencies among tasks of different pools are
+   not affected; a pool belongs to one group at most and must be
+   removed from its group before it is destroyed */
+class pool_group {
+   public:
+      pool_group() : state(std::make_shared<impl::balancing::group_state>()) {
+      }
+      ~pool_group() {
+	 impl::balancing::dissolve(*state);
+      }
+      pool_group(const pool_group&) = delete;
+      pool_group& operator=(const pool_group&) = delete;
+      /* add a pool to this group or update its rules;
+	 returns false if the pool belongs to another group */
+      bool add(thread_pool& tp, unsigned int workers,
+	    const balancing_rules& rules = {}) {
+	 return impl::balancing::join(state, tp, workers, rules);
+      }
+      /* remove a pool from this group, if it belongs to it;
+	 its jobs which are already queued are still run */
+      void remove(thread_pool& tp) {
+	 impl::balancing::leave(*state, tp);
+      }
+   private:
+      std::shared_ptr<impl::balancing::group_state> state;
+};
+
+struct warm_up_options {
+   unsigned int threads = 0; /* of the pool, 0: hardware concurrency */
+   bool pin = false; /* pin the i-th worker to the i-th CPU (Linux only) */
+   std::size_t tasks = 0; /* number of vertices and task records */
+   std::size_t stack = 64 * 1024; /* bytes of stack touched per worker */
+   std::chrono::milliseconds timeout{1000}; /* to wait for the workers */
+};
+
+namespace impl {
+
+/* touch the given number of bytes of the stack */
+[[gnu::noinline]] inline void touch_stack(std::size_t bytes) {
+   volatile char buffer[4096];
+   buffer[0] = 0; buffer[sizeof buffer - 1] = 0;
+   if (bytes > sizeof buffer) touch_stack(bytes - sizeof buffer);
+}
+
+/* estimated size of a shared object created by slots::make_shared */
+template<typename T>
+constexpr std::size_t shared_size() {
+   return sizeof(T) + 2 * sizeof(void*);
+}
+
+} // namespace impl
+
+/* start all threads of the pool by blocking them until all of them
+   arrived, pin them if requested, touch their stacks, initialize
+   their thread-local state, and pre-allocate the slots of the given
+   number of tasks such that the first graphs run at full speed;
+   returns the number of workers that arrived before the timeout */
+inline unsigned int warm_up(thread_pool& tp,
+      const warm_up_options& options = {}) {
+   namespace slots = impl::slots;
+   slots::reserve(impl::shared_size<impl::task_handle_rec>(), options.tasks);
+   slots::reserve(impl::task_handle_rec::dependent_size(), options.tasks);
+   slots::reserve(impl::shared_size<impl::task_rec<int>>(), options.tasks);
+
+   unsigned int threads = options.threads;
+   if (threads == 0) threads = std::thread::hardware_concurrency();
+   if (threads == 0) threads = 1;
+   struct state {
+      std::atomic<unsigned int> arrived{0};
+      std::atomic<unsigned int> left{0};
+   };
+   auto s = std::make_shared<state>();
+   s->left = threads;
+   auto deadline = std::chrono::steady_clock::now() + options.timeout;
+   for (unsigned int i = 0; i < threads; ++i) {
+      /* bypasses pool groups as the jobs must not be stolen */
+      impl::compensation::submit(tp, [=]() {
+	 auto index = s->arrived++;
+#if defined(__linux__)
+	 if (options.pin) {
+	    auto cpus = std::thread::hardware_concurrency();
+	    cpu_set_t set;
+	    CPU_ZERO(&set);
+	    CPU_SET(index % (cpus? cpus: 1), &set);
+	    pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+	 }
+#endif
+	 impl::touch_stack(options.stack);
+	 impl::thread_metrics::get();
+	 slots::deallocate(slots::allocate(1), 1);
+	 while (s->arrived < threads &&
+	       std::chrono::steady_clock::now() < deadline) {
+	    std::this_thread::yield();
+	 }
+	 --s->left;
+      });
+   }
+   while (s->left > 0 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+   }
+   return std::min(s->arrived.load(), threads);
+}
+
+namespace metrics {
+
+/* turn the instrumentation on or off; this affects tasks
+   submitted afterwards */
+inline void enable(bool on = true) {
+   impl::metrics_enabled.store(on, std::memory_order_relaxed);
+}
+inline bool enabled() {
+   return impl::metrics_enabled.load(std::memory_order_relaxed);
+}
+
+/* while the counters consider all tasks, the latencies are recorded
+   for sampled tasks only; the decision is taken at submission time:
+   by default, all tasks are sampled; set_sampling_interval(n) samples
+   1 in n tasks per submitting thread, or none for n = 0 */
+inline void set_sampling_interval(unsigned int n) {
+   impl::sampling_interval.store(n, std::memory_order_relaxed);
+}
+/* sample all tasks of the given label independent of the interval */
+inline void sample_label(const std::string& label) {
+   /* earlier sets are kept as they might be still in use */
+   static std::mutex mutex;
+   static std::deque<impl::label_set> sets;
+   std::lock_guard lock(mutex);
+   auto current = impl::sampled_labels.load(std::memory_order_relaxed);
+   sets.push_back(current? *current: impl::label_set{});
+   sets.back().push_back(label);
+   impl::sampled_labels.store(&sets.back(), std::memory_order_release);
+}
+/* sample additionally every task whose last dependency
+   to finish was sampled, i.e. follow sampled tasks along
+   their critical paths */
+inline void sample_critical_paths(bool on = true) {
+   impl::sampling_follows_critical_paths.store(on,
+      std::memory_order_relaxed);
+}
+
+/* merge the histograms of all threads;
+   this does neither lock nor stop any of the recording threads */
+inline std::map<std::string, label_histograms> snapshot() {
+   std::map<std::string, label_histograms> result;
+   impl::thread_metrics::for_each([&](const impl::thread_metrics& shard) {
+      for (auto p = shard.first_label(); p; p = p->next) {
+	 auto& histograms = result[p->label];
+	 for (std::size_t i = 0; i < phases; ++i) {
+	    p->histograms[i].merge_into(histograms[i]);
+	 }
+      }
+   });
+   return result;
+}
+
+inline const char* phase_name(phase p) {
+   static const char* names[] = {"queueing", "release", "execution"};
+   return names[p];
+}
+
+/* print p50, p99, and p99.9 in microseconds per label and phase */
+inline void report(std::ostream& out) {
+   for (auto& [label, histograms]: snapshot()) {
+      for (std::size_t i = 0; i < phases; ++i) {
+	 auto& h = histograms[i];
+	 if (h.count() == 0) continue;
+	 out << (label.empty()? "-": label) << ' ' <<
+	    phase_name(static_cast<phase>(i)) <<
+	    ": n=" << h.count() <<
+	    " p50=" << h.p50() / 1000.0 << "us" <<
+	    " p99=" << h.p99() / 1000.0 << "us" <<
+	    " p99.9=" << h.p999() / 1000.0 << "us" << std::endl;
+      }
+   }
+}
+
+/* profile of one lock class, see MT_TASK_LOCK_PROFILING */
+struct lock_statistics {
+   const char* name;
+   std::uint64_t acquisitions;
+   std::uint64_t contentions; /* acquisitions that had to wait */
+   std::uint64_t wait_time; /* in ns */
+};
+
+/* return the lock statistics ranked by their total waiting time;
+   the list is empty unless MT_TASK_LOCK_PROFILING is defined */
+inline std::vector<lock_statistics> lock_profile() {
+   std::vector<lock_statistics> result;
+#ifdef MT_TASK_LOCK_PROFILING
+   static const char* names[] = {
+      "parking lot", "thread_pool (time in submit)",
+   };
+   for (std::size_t i = 0; i < impl::lock_classes; ++i) {
+      auto lc = static_cast<impl::lock_class>(i);
+      lock_statistics stats{names[i], 0, 0, 0};
+      impl::thread_metrics::for_each([&](const impl::thread_metrics& shard) {
+	 stats.acquisitions += shard.get_count(lc, impl::lock_acquisitions);
+	 stats.contentions += shard.get_count(lc, impl::lock_contentions);
+	 stats.wait_time += shard.get_count(lc, impl::lock_wait_time);
+      });
+      result.push_back(stats);
+   }
+   std::stable_sort(result.begin(), result.end(),
+      [](const lock_statistics& s1, const lock_statistics& s2) {
+	 return s1.wait_time > s2.wait_time;
+      });
+#endif
+   return result;
 }
 
+/* print the ranked lock profile */
+inline void lock_report(std::ostream& out) {
+   for (auto& stats: lock_profile()) {
+      out << stats.name << ": " << stats.acquisitions << " acquisitions, " <<
+	 stats.contentions << " contended";
+      if (stats.acquisitions > 0) {
+	 out << " (" << stats.contentions * 100.0 / stats.acquisitions <<
+	    "%)";
+      }
+      out << ", " << stats.wait_time / 1000.0 << "us waiting" << std::endl;
+   }
+}
+
+} // namespace metrics
+
+namespace impl {
+
+inline std::string escape_label_value(const std::string& value) {
+   std::string result;
+   for (char ch: value) {
+      switch (ch) {
+	 case '\\': result += "\\\\"; break;
+	 case '"': result += "\\\""; break;
+	 case '\n': result += "\\n"; break;
+	 default: result += ch; break;
+      }
+   }
+   return result;
+}
+
+inline void write_metric(std::ostream& out, const char* name,
+      const char* type, const char* help, std::int64_t value) {
+   out << "# HELP " << name << ' ' << help << '\n' <<
+      "# TYPE " << name << ' ' << type << '\n' <<
+      name << ' ' << value << '\n';
+}
+
+} // namespace impl
+
+namespace metrics {
+
+/* render the counters, gauges, and latency histograms of the
+   task layer in the Prometheus text exposition format;
+   the pool metrics cover the jobs submitted by the task layer;
+   like snapshot() this neither locks nor stops any other thread */
+inline void write_prometheus(std::ostream& out) {
+   std::int64_t counts[impl::counters] = {};
+   impl::thread_metrics::for_each([&](const impl::thread_metrics& shard) {
+      for (std::size_t i = 0; i < impl::counters; ++i) {
+	 counts[i] += shard.get_count(static_cast<impl::counter>(i));
+      }
+   });
+   /* the shards are read one after another, hence
+      differences may be slightly off and must not become negative */
+   auto gauge = [&](impl::counter from, impl::counter to) {
+      return std::max(counts[from] - counts[to], std::int64_t{0});
+   };
+   impl::write_metric(out, "mt_tasks_submitted_total", "counter",
+      "Number of submitted tasks.", counts[impl::tasks_submitted]);
+   impl::write_metric(out, "mt_tasks_finished_total", "counter",
+      "Number of finished tasks.", counts[impl::tasks_finished]);
+   impl::write_metric(out, "mt_tasks_waiting", "gauge",
+      "Number of tasks waiting for their dependencies.",
+      gauge(impl::tasks_submitted, impl::tasks_ready));
+   impl::write_metric(out, "mt_tasks_queued", "gauge",
+      "Number of ready tasks waiting for a worker.",
+      gauge(impl::tasks_ready, impl::tasks_started));
+   impl::write_metric(out, "mt_tasks_running", "gauge",
+      "Number of tasks in execution.",
+      gauge(impl::tasks_started, impl::tasks_finished));
+   impl::write_metric(out, "mt_pool_jobs_submitted_total", "counter",
+      "Number of jobs passed to the thread pool.",
+      counts[impl::jobs_submitted]);
+   impl::write_metric(out, "mt_pool_jobs_queued", "gauge",
+      "Number of jobs in the queue of the thread pool.",
+      gauge(impl::jobs_submitted, impl::jobs_started));
+   impl::write_metric(out, "mt_pool_jobs_running", "gauge",
+      "Number of busy workers of the thread pool.",
+      gauge(impl::jobs_started, impl::jobs_finished));
+
+   static const double bounds[] = {
+      1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4,
+      1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5,
+      1, 2.5, 5, 10,
+   };
+   const char* name = "mt_task_latency_seconds";
+   out << "# HELP " << name << " Latency of tasks per label and phase.\n" <<
+      "# TYPE " << name << " histogram\n";
+   for (auto& [label, histograms]: snapshot()) {
+      for (std::size_t i = 0; i < phases; ++i) {
+	 auto& h = histograms[i];
+	 if (h.count() == 0) continue;
+	 std::string labels = "label=\"" + impl::escape_label_value(label) +
+	    "\",phase=\"" + phase_name(static_cast<phase>(i)) + "\"";
+	 std::size_t index = 0; std::uint64_t cumulative = 0;
+	 for (auto bound: bounds) {
+	    auto ns = static_cast<std::uint64_t>(bound * 1e9);
+	    while (index < histogram::buckets &&
+		  histogram::highest_value(index) <= ns) {
+	       cumulative += h.count(index++);
+	    }
+	    out << name << "_bucket{" << labels << ",le=\"" << bound <<
+	       "\"} " << cumulative << '\n';
+	 }
+	 out << name << "_bucket{" << labels << ",le=\"+Inf\"} " <<
+	    h.count() << '\n';
+	 out << name << "_sum{" << labels << "} " << h.sum() / 1e9 << '\n';
+	 out << name << "_count{" << labels << "} " << h.count() << '\n';
+      }
+   }
+}
+
+inline std::string prometheus_text() {
+   std::ostringstream out;
+   write_prometheus(out);
+   return out.str();
+}
+
+#if __has_include(<unistd.h>)
+/* write the Prometheus text to the given file descriptor;
+   false is returned in case of write errors */
+inline bool write_prometheus(int fd) {
+   auto text = prometheus_text();
+   const char* s = text.data(); std::size_t left = text.size();
+   while (left > 0) {
+      auto nbytes = ::write(fd, s, left);
+      if (nbytes < 0) {
+	 if (errno == EINTR) continue;
+	 return false;
+      }
+      s += nbytes; left -= nbytes;
+   }
+   return true;
+}
+#endif
+
+} // namespace metrics
+
 } // namespace mt
 
 #endif // of #if __cplusplus < 201402L #else ...
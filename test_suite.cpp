@@ -23,8 +23,16 @@
    SOFTWARE.
 */
 
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <task.hpp>
 #include <thread_pool.hpp>
@@ -180,6 +188,622 @@ bool t5() {
    return result->get_value() == 4950;
 }
 
+/* test that the instrumentation accounts all tasks of a label */
+bool t6() {
+   mt::metrics::enable();
+   mt::thread_pool tp(2);
+   {
+      mt::task_group tg(tp);
+      mt::task_attributes attributes{"t6"};
+      auto a = tg.submit(attributes, {}, []() {
+	 return 20;
+      });
+      auto b = tg.submit(attributes, {}, []() {
+	 return 22;
+      });
+      tg.submit(attributes, {a, b}, [=]() {
+	 return a->get_value() + b->get_value();
+      });
+   }
+   mt::metrics::enable(false);
+   auto histograms = mt::metrics::snapshot()["t6"];
+   auto& queueing = histograms[mt::metrics::queueing];
+   auto& execution = histograms[mt::metrics::execution];
+   return queueing.count() == 3 && execution.count() == 3 &&
+      execution.p50() <= execution.p99() &&
+      execution.p99() <= execution.p999();
+}
+
+/* test the export of the metrics in the Prometheus text format */
+bool t7() {
+   mt::metrics::enable();
+   mt::thread_pool tp(2);
+   {
+      mt::task_group tg(tp);
+      mt::task_attributes attributes{"t7"};
+      auto a = tg.submit(attributes, {}, []() {
+	 return 20;
+      });
+      tg.submit(attributes, {a}, [=]() {
+	 return a->get_value() + 22;
+      });
+   }
+   mt::metrics::enable(false);
+   auto text = mt::metrics::prometheus_text();
+   return text.find("# TYPE mt_tasks_finished_total counter\n") !=
+	 std::string::npos &&
+      text.find("mt_task_latency_seconds_count"
+	 "{label=\"t7\",phase=\"execution\"} 2\n") != std::string::npos;
+}
+
+/* test that the sampling restricts the recorded latencies */
+bool t8() {
+   mt::metrics::enable();
+   mt::metrics::set_sampling_interval(0);
+   mt::metrics::sample_label("t8-sampled");
+   mt::thread_pool tp(2);
+   {
+      mt::task_group tg(tp);
+      for (int i = 0; i < 10; ++i) {
+	 tg.submit(mt::task_attributes{"t8-sampled"}, {}, [=]() {
+	    return i;
+	 });
+	 tg.submit(mt::task_attributes{"t8-unsampled"}, {}, [=]() {
+	    return i;
+	 });
+      }
+   }
+   mt::metrics::enable(false);
+   mt::metrics::set_sampling_interval(1);
+   auto histograms = mt::metrics::snapshot();
+   return histograms["t8-sampled"][mt::metrics::execution].count() == 10 &&
+      histograms["t8-unsampled"][mt::metrics::execution].count() == 0;
+}
+
+/* test that the lock profiling sees the locks of the task layer */
+bool t9() {
+   mt::thread_pool tp(2);
+   {
+      mt::task_group tg(tp);
+      auto a = tg.submit({}, []() {
+	 /* make sure that the group is waited for in the parking lot */
+	 std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	 return 20;
+      });
+      tg.submit({a}, [=]() {
+	 return a->get_value() + 22;
+      });
+   }
+   auto profile = mt::metrics::lock_profile();
+#ifdef MT_TASK_LOCK_PROFILING
+   if (profile.size() != 2) return false;
+   for (auto& stats: profile) {
+      if (stats.acquisitions == 0) return false;
+      if (stats.contentions > stats.acquisitions) return false;
+   }
+   return true;
+#else
+   return profile.empty();
+#endif
+}
+
+/* many threads attach dependents concurrently to a few vertices */
+bool t10() {
+   mt::thread_pool tp(2);
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   auto root = mt::submit(tp, {}, [=]() { opened.wait(); });
+   mt::task<void> hubs[] = {
+      mt::submit(tp, {root}, []() {}),
+      mt::submit(tp, {root}, []() {}),
+   };
+   std::atomic<unsigned int> executed{0};
+   std::vector<std::thread> threads;
+   for (unsigned int i = 0; i < 8; ++i) {
+      threads.emplace_back([&, i]() {
+	 for (unsigned int j = 0; j < 1000; ++j) {
+	    mt::submit(tp, {hubs[(i + j) % 2]}, [&]() { ++executed; });
+	 }
+      });
+   }
+   for (auto& t: threads) t.join();
+   if (executed > 0) return false;
+   gate.set_value();
+   for (auto& hub: hubs) hub->join();
+   {
+      /* dependencies that are already finished */
+      mt::task_group tg(tp);
+      for (unsigned int i = 0; i < 1000; ++i) {
+	 tg.submit({hubs[i % 2]}, [&]() { ++executed; });
+      }
+   }
+   /* a lost registration would leave a task behind forever */
+   auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::seconds(10);
+   while (executed < 9000 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+   }
+   return executed == 9000;
+}
+
+/* task with many dependencies, half of them already finished */
+bool t11() {
+   mt::thread_pool tp(2);
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   auto root = mt::submit(tp, {}, [=]() { opened.wait(); });
+   std::vector<mt::task<int>> dependencies;
+   for (int i = 0; i < 300; ++i) {
+      if (i % 2) {
+	 dependencies.push_back(mt::submit(tp, {root}, [=]() { return i; }));
+      } else {
+	 dependencies.push_back(mt::submit(tp, {}, [=]() { return i; }));
+	 dependencies.back()->join();
+      }
+   }
+   auto sum = mt::submit(tp, dependencies.begin(), dependencies.end(),
+      [&]() {
+	 int sum = 0;
+	 for (auto& dependency: dependencies) {
+	    sum += dependency->get_value();
+	 }
+	 return sum;
+      });
+   gate.set_value();
+   return sum->get_value() == 300 * 299 / 2;
+}
+
+/* dependencies on root tasks which are running, finished, or
+   which return tasks themselves */
+bool t12() {
+   mt::thread_pool tp(2);
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   auto running = mt::submit(tp, {}, [=]() { opened.wait(); return 1; });
+   auto finished = mt::submit(tp, {}, []() { return 2; });
+   finished->join();
+   auto nested = mt::submit(tp, {}, [&]() {
+      return mt::submit(tp, {}, []() { return 3; });
+   });
+   std::atomic<int> sum{0};
+   {
+      mt::task_group tg(tp);
+      for (int i = 0; i < 100; ++i) {
+	 tg.submit({running, finished, nested}, [&]() {
+	    sum += running->get_value() + finished->get_value() +
+	       nested->get_value();
+	 });
+      }
+      gate.set_value();
+   }
+   return sum == 600;
+}
+
+/* long chain where each task is handed off to the worker
+   that finished its predecessor */
+bool t13() {
+   mt::thread_pool tp(2);
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   unsigned int count = 0;
+   mt::task<void> t = mt::submit(tp, {}, [=]() { opened.wait(); });
+   for (unsigned int i = 0; i < 100000; ++i) {
+      t = mt::submit(tp, {t}, [&count, i]() {
+	 if (count == i) ++count;
+      });
+   }
+   gate.set_value();
+   t->join();
+   return count == 100000;
+}
+
+/* bulk graph where the linear chains are fused */
+bool t14() {
+   mt::thread_pool tp(2);
+   std::atomic<int> values[3] = {};
+   mt::graph g;
+   auto root = g.add({}, [&]() { values[0] = 1; });
+   mt::graph::node left = root, right = root;
+   for (int i = 0; i < 10; ++i) {
+      left = g.add({left}, [&, i]() {
+	 if (values[1] == i) ++values[1];
+      });
+      right = g.add({right}, [&, i]() {
+	 if (values[2] == i) ++values[2];
+      });
+   }
+   auto sum = 0;
+   g.add({left, right}, [&]() {
+      sum = values[0] + values[1] + values[2];
+   });
+   /* both chains except their first task are fused */
+   if (g.fuse_chains() != 18 || g.units() != 4) return false;
+   g.run(tp);
+   return sum == 21;
+}
+
+/* bulk graph with duplicate and transitively implied edges */
+bool t15() {
+   mt::thread_pool tp(2);
+   std::atomic<int> count{0};
+   auto check = [&](int expected) {
+      return [&count, expected]() {
+	 if (count == expected) ++count;
+      };
+   };
+   mt::graph g;
+   auto a = g.add({}, check(0));
+   auto b = g.add({a, a}, check(1));
+   auto c = g.add({a, b}, check(2));
+   auto d = g.add({c, a, b, c}, check(3));
+   g.add({d, b}, check(4));
+   if (g.reduce_edges() != 6) return false;
+   /* the graph is now a chain */
+   if (g.fuse_chains() != 4 || g.units() != 1) return false;
+   g.run(tp);
+   return count == 5;
+}
+
+/* warm-up of a pool followed by a small graph */
+bool t16() {
+   mt::thread_pool tp(2);
+   mt::warm_up_options options;
+   options.threads = 2;
+   options.tasks = 1000;
+   if (mt::warm_up(tp, options) != 2) return false;
+   auto a = mt::submit(tp, {}, []() { return 20; });
+   auto b = mt::submit(tp, {a}, [=]() { return a->get_value() + 22; });
+   return b->get_value() == 42;
+}
+
+/* drain policies of task groups */
+bool t17() {
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   std::atomic<int> executed{0};
+   std::atomic<bool> started{false};
+   bool ok = true;
+   {
+      mt::thread_pool tp(2);
+      {
+	 mt::task_group tg(tp);
+	 auto running = tg.submit({}, [=, &started]() {
+	    started = true; opened.wait(); return 1;
+	 });
+	 std::vector<mt::task<int>> waiting;
+	 for (int i = 0; i < 100; ++i) {
+	    waiting.push_back(tg.submit({running}, [&]() {
+	       ++executed; return 2;
+	    }));
+	 }
+	 while (!started) std::this_thread::yield();
+	 std::thread opener([&]() {
+	    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	    gate.set_value();
+	 });
+	 ok = tg.drain(mt::drain_policy::cancel_waiting) &&
+	    running->get_value() == 1 && executed == 0;
+	 opener.join();
+	 try {
+	    waiting.front()->get_value();
+	    ok = false;
+	 } catch (mt::task_cancelled&) {
+	 }
+      }
+      /* a task that is still running when the deadline expires */
+      std::promise<void> gate2;
+      auto opened2 = gate2.get_future().share();
+      started = false;
+      {
+	 mt::task_group tg(tp);
+	 tg.submit({}, [=, &started]() { started = true; opened2.wait(); });
+	 for (int i = 0; i < 10; ++i) {
+	    tg.submit({}, [&]() { ++executed; });
+	 }
+	 while (!started) std::this_thread::yield();
+	 if (tg.drain(mt::drain_policy::abort,
+	       std::chrono::milliseconds(10))) {
+	    ok = false;
+	 }
+      }
+      gate2.set_value();
+   }
+   return ok;
+}
+
+/* polling with is_ready and try_get */
+bool t18() {
+   mt::thread_pool tp(2);
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   auto a = mt::submit(tp, {}, [=]() { opened.wait(); return 20; });
+   auto b = mt::submit(tp, {a}, [=]() { return a->get_value() + 22; });
+   auto c = mt::submit(tp, {}, [=, &tp]() {
+      return mt::submit(tp, {b}, [=]() { return b->get_value() + 1; });
+   });
+   auto d = mt::submit(tp, {b}, []() {});
+   if (a->is_ready() || b->is_ready() || b->try_get() || d->try_get()) {
+      return false;
+   }
+   gate.set_value();
+   while (!c->is_ready() || !d->is_ready()) {
+      std::this_thread::yield();
+   }
+   auto value = c->try_get();
+   auto e = mt::submit(tp, {}, []() -> int { throw 42; });
+   while (!e->is_ready()) {
+      std::this_thread::yield();
+   }
+   bool thrown = false;
+   try {
+      e->try_get();
+   } catch (int) {
+      thrown = true;
+   }
+   return thrown && a->is_ready() && *a->try_get() == 20 &&
+      *b->try_get() == 42 && value && *value == 43;
+}
+
+/* concurrent waiters of a result slot, move-only task functions,
+   and results that need to be destructed */
+bool t19() {
+   mt::thread_pool tp(2);
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   auto value = std::make_unique<std::string>("42");
+   auto a = mt::submit(tp, {}, [=, value = std::move(value)]() {
+      opened.wait(); return *value;
+   });
+   std::atomic<unsigned int> ok{0};
+   std::vector<std::thread> waiters;
+   for (unsigned int i = 0; i < 4; ++i) {
+      waiters.emplace_back([&]() {
+	 if (a->get_value() == "42") ++ok;
+      });
+   }
+   std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   gate.set_value();
+   for (auto& waiter: waiters) {
+      waiter.join();
+   }
+   return ok == 4;
+}
+
+/* many threads parked at many tasks and at a task group */
+bool t20() {
+   mt::thread_pool tp(2);
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   std::atomic<unsigned int> sum{0};
+   {
+      mt::task_group tg(tp);
+      std::vector<mt::task<unsigned int>> tasks;
+      for (unsigned int i = 0; i < 256; ++i) {
+	 tasks.push_back(tg.submit({}, [=]() { opened.wait(); return i; }));
+      }
+      std::vector<std::thread> waiters;
+      for (unsigned int i = 0; i < 8; ++i) {
+	 waiters.emplace_back([&, i]() {
+	    if (i % 2) {
+	       tg.join();
+	    }
+	    for (auto& t: tasks) {
+	       sum += t->get_value();
+	    }
+	 });
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      gate.set_value();
+      for (auto& waiter: waiters) {
+	 waiter.join();
+      }
+   }
+   return sum == 8 * 255 * 256 / 2;
+}
+
+/* tasks waiting for their subtasks in get_value on a single worker
+   which would deadlock unless the waiting tasks are suspended */
+bool t21() {
+   if (!mt::fibers::enabled()) return true;
+   mt::thread_pool tp(1);
+   std::function<unsigned int(unsigned int)> fib;
+   fib = [&](unsigned int n) -> unsigned int {
+      if (n <= 1) return n;
+      auto sum1 = mt::submit(tp, {}, fib, n - 1);
+      auto sum2 = mt::submit(tp, {}, fib, n - 2);
+      return sum1->get_value() + sum2->get_value();
+   };
+   auto result = mt::submit(tp, {}, fib, 15);
+   return result->get_value() == 610;
+}
+
+/* blocked workers are compensated by additional workers */
+bool t22() {
+   mt::thread_pool tp(1);
+   bool ok;
+   {
+      mt::blocking_compensation compensation(tp, 2);
+      std::promise<void> gate;
+      auto opened = gate.get_future().share();
+      auto a = mt::submit(tp, {}, [=]() {
+	 mt::blocking_section section;
+	 opened.wait();
+	 return 20;
+      });
+      auto b = mt::submit(tp, {}, [&]() {
+	 gate.set_value();
+	 return 22;
+      });
+      auto c = mt::submit(tp, {}, [&tp]() {
+	 /* waits for a task that is queued behind us */
+	 auto d = mt::submit(tp, {}, []() { return 1; });
+	 return d->get_value();
+      });
+      ok = a->get_value() + b->get_value() + c->get_value() == 43;
+      try {
+	 mt::blocking_compensation twice(tp, 1);
+	 ok = false;
+      } catch (std::invalid_argument&) {
+      }
+   }
+   /* the pool may be compensated again once the first one is gone */
+   mt::blocking_compensation compensation(tp, 1);
+   return ok && mt::submit(tp, {}, []() { return 1; })->get_value() == 1;
+}
+
+bool t23() {
+   mt::thread_pool tp(1);
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   /* keeps the only worker busy until we wait for y */
+   auto busy = mt::submit(tp, {}, [=]() { opened.wait(); });
+   std::atomic<int> counter{0};
+   std::vector<mt::task<void>> background;
+   for (int i = 0; i < 50; ++i) {
+      background.push_back(mt::submit(tp, {}, [&]() { ++counter; }));
+   }
+   auto x = mt::submit(tp, {}, [&]() { return counter.load(); });
+   auto y = mt::submit(tp, {x}, [&]() { return counter.load(); });
+   /* the gate is opened as soon as the job of x is in the urgent lane
+      or when the worker took it before it ran busy */
+   std::thread opener([&]() {
+      while (mt::impl::urgent::pending.load() == 0 && !y->is_ready()) {
+	 std::this_thread::yield();
+      }
+      gate.set_value();
+   });
+   /* x and y overtake the background tasks as we wait for y */
+   bool ok = y->get_value() < 50 && x->get_value() < 50;
+   opener.join();
+   for (auto& t: background) t->join();
+   return ok && counter == 50;
+}
+
+/* lazy tasks are run on demand only and freed if never demanded */
+bool t24() {
+   mt::thread_pool tp(2);
+   mt::task_attributes lazy;
+   lazy.lazy = true;
+   std::atomic<int> runs{0};
+   auto a = mt::submit(tp, lazy, {}, [&]() { ++runs; return 20; });
+   auto b = mt::submit(tp, lazy, {a}, [&, a]() {
+      ++runs; return a->get_value() + 1;
+   });
+   auto c = mt::submit(tp, lazy, {}, [&]() { ++runs; return 21; });
+   /* demanded by a dependent which is not lazy */
+   auto d = mt::submit(tp, {c}, [=]() { return c->get_value() * 2; });
+   bool ok = d->get_value() == 42 && runs == 1 && !a->is_ready();
+   ok = ok && b->get_value() == 21 && runs == 3;
+   auto resource = std::make_shared<int>(0);
+   {
+      auto e = mt::submit(tp, lazy, {}, [&, resource]() { ++runs; });
+      auto f = mt::submit(tp, lazy, {e}, [&, resource]() { ++runs; });
+   }
+   return ok && runs == 3 && resource.use_count() == 1;
+}
+
+/* idle workers of a pool run the jobs of a busy sibling */
+bool t25() {
+   mt::thread_pool tp1(1);
+   mt::thread_pool tp2(1);
+   mt::pool_group group;
+   if (!group.add(tp1, 1) || !group.add(tp2, 1)) return false;
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   auto busy = mt::submit(tp1, {}, [=]() { opened.wait(); });
+   /* queued behind busy in tp1 but stolen by the worker of tp2 */
+   auto a = mt::submit(tp1, {}, []() { return 20; });
+   auto b = mt::submit(tp2, {a}, [=]() { return a->get_value() + 22; });
+   bool ok = b->get_value() == 42 && !busy->is_ready();
+   gate.set_value();
+   busy->join();
+   /* a pool may join another group once it left its group */
+   mt::pool_group other;
+   ok = ok && !other.add(tp1, 1);
+   group.remove(tp1);
+   ok = ok && other.add(tp1, 1) &&
+      mt::submit(tp1, {}, []() { return 1; })->get_value() == 1;
+   return ok;
+}
+
+/* an arena runs its tasks on a limited number of workers */
+bool t26() {
+   mt::thread_pool tp(4);
+   mt::task_arena narrow(tp, 1);
+   std::atomic<int> running{0};
+   std::atomic<int> max_running{0};
+   {
+      mt::task_group tg(narrow);
+      for (int i = 0; i < 20; ++i) {
+	 tg.submit({}, [&]() {
+	    int n = ++running;
+	    int max = max_running;
+	    while (n > max && !max_running.compare_exchange_weak(max, n));
+	    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	    --running;
+	 });
+      }
+   }
+   bool ok = max_running == 1;
+   /* an idle lending arena lends its slot to a busy one */
+   mt::task_arena lender(tp, 1, true);
+   mt::task_arena busy(tp, 1);
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   auto blocker = mt::submit(busy, {}, [=]() { opened.wait(); });
+   auto a = mt::submit(busy, {}, []() { return 42; });
+   ok = ok && a->get_value() == 42 && !blocker->is_ready();
+   gate.set_value();
+   blocker->join();
+   return ok;
+}
+
+/* weighted task groups are served in turn instead of in FIFO order */
+bool t27() {
+   mt::thread_pool tp(1);
+   std::promise<void> gate;
+   auto opened = gate.get_future().share();
+   auto blocker = mt::submit(tp, {}, [=]() { opened.wait(); });
+   std::string log;
+   {
+      mt::task_group noisy(tp, 1);
+      mt::task_group quiet(tp, 2);
+      for (int i = 0; i < 100; ++i) {
+	 noisy.submit({}, [&]() { log += 'n'; });
+      }
+      for (int i = 0; i < 6; ++i) {
+	 quiet.submit({}, [&]() { log += 'q'; });
+      }
+      gate.set_value();
+   }
+   /* quiet gets two jobs for every job of noisy */
+   return log.size() == 106 && log.substr(0, 9) == "nqqnqqnqq";
+}
+
+/* tasks that return references, directly and through nested tasks */
+bool t28() {
+   mt::thread_pool tp(2);
+   static int global = 7;
+   auto a = mt::submit(tp, {}, []() -> int& { return global; });
+   auto b = mt::submit(tp, {a}, [=]() -> const int& {
+      return a->get_value();
+   });
+   auto c = mt::submit(tp, {}, [&tp]() {
+      return mt::submit(tp, {}, []() -> int& { return global; });
+   });
+   b->join(); c->join();
+   int* p = a->try_get();
+   const int* q = b->try_get();
+   int* r = c->try_get();
+   if (&a->get_value() != &global || p != &global ||
+	 &b->get_value() != &global || q != &global ||
+	 &c->get_value() != &global || r != &global) {
+      return false;
+   }
+   a->get_value() = 42;
+   return global == 42 && *q == 42;
+}
+
 int main() {
    statistics stats;
    t(" t1", t1, stats);
@@ -187,6 +811,29 @@ int main() {
    t(" t3", t3, stats);
    t(" t4", t4, stats);
    t(" t5", t5, stats);
+   t(" t6", t6, stats);
+   t(" t7", t7, stats);
+   t(" t8", t8, stats);
+   t(" t9", t9, stats);
+   t(" t10", t10, stats);
+   t(" t11", t11, stats);
+   t(" t12", t12, stats);
+   t(" t13", t13, stats);
+   t(" t14", t14, stats);
+   t(" t15", t15, stats);
+   t(" t16", t16, stats);
+   t(" t17", t17, stats);
+   t(" t18", t18, stats);
+   t(" t19", t19, stats);
+   t(" t20", t20, stats);
+   t(" t21", t21, stats);
+   t(" t22", t22, stats);
+   t(" t23", t23, stats);
+   t(" t24", t24, stats);
+   t(" t25", t25, stats);
+   t(" t26", t26, stats);
+   t(" t27", t27, stats);
+   t(" t28", t28, stats);
    unsigned int tests = stats.passed + stats.failed;
    if (tests == stats.passed) {
       std::cout << "all tests passed" << std::endl;